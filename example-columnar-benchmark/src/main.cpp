@@ -0,0 +1,119 @@
+//
+//  main.cpp
+//  ofxCMS columnar benchmark
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; compares equality and range scans on a collection with a
+//  column store (see Collection::columns) against the same scans on a plain collection,
+//  which evaluates its filters per model (modelPassesSingleValueFilter).
+//
+//  Usage: columnarBenchmark [number of models] [repetitions] (default: 100000 10)
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+
+static const int CATEGORIES = 50;
+
+void populate(CMS::Collection<CMS::Model> &collection, int count){
+    vector<CMS::Model*> models;
+    for(int i=0; i<count; i++){
+        CMS::Model *model = new CMS::Model();
+        model->set("id", ofToString(i));
+        model->set("category", "category" + ofToString(i % CATEGORIES));
+        model->set("year", ofToString(1950 + i % 70));
+        model->set("title", "title " + ofToString(i));
+        model->set("body", "body of record " + ofToString(i));
+        models.push_back(model);
+    }
+
+    collection.addMany(models);
+}
+
+class Result {
+public:
+    Result() : findMs(0.0f), filterMs(0.0f), rejectMs(0.0f), rangeMs(0.0f), models(0){}
+    float findMs, filterMs, rejectMs, rangeMs;
+    unsigned int models;
+};
+
+float elapsedMs(unsigned long long startTime){
+    return (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
+
+Result benchmark(CMS::Collection<CMS::Model> &source, bool useColumns, int repetitions){
+    CMS::Collection<CMS::Model> collection;
+
+    if(useColumns){
+        vector<string> attrs;
+        attrs.push_back("category");
+        attrs.push_back("year");
+        collection.columns(attrs);
+    }
+
+    collection.clone(source);
+
+    // none of the scans match (or remove) anything, so they can be repeated on the same
+    // models and only the predicate evaluation is measured; removing models costs the same
+    // either way
+    vector<string> categories;
+    for(int i=0; i<CATEGORIES; i++) categories.push_back("category" + ofToString(i));
+
+    Result result;
+
+    for(int r=0; r<repetitions; r++){
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        collection.findByAttr("category", "none");
+        result.findMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterBy("category", categories);
+        result.filterMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.rejectBy("category", "none");
+        result.rejectMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterByRange("year", 1900, 2100);
+        result.rangeMs += elapsedMs(startTime);
+    }
+
+    result.models = collection.count();
+    result.findMs /= repetitions;
+    result.filterMs /= repetitions;
+    result.rejectMs /= repetitions;
+    result.rangeMs /= repetitions;
+    return result;
+}
+
+void print(const string &name, const Result &result){
+    char line[256];
+    snprintf(line, sizeof(line), "%-10s %12.3f %12.3f %12.3f %12.3f %10u\n", name.c_str(), result.findMs, result.filterMs, result.rejectMs, result.rangeMs, result.models);
+    cout << line;
+}
+
+int main(int argc, char *argv[]){
+    int count = argc > 1 ? std::max(1, ofToInt(argv[1])) : 100000;
+    int repetitions = argc > 2 ? std::max(1, ofToInt(argv[2])) : 10;
+
+    // collections log every model they destroy
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    CMS::Collection<CMS::Model> source;
+    source.setDestroyOnRemove(true);
+    populate(source, count);
+
+    Result plain = benchmark(source, false, repetitions);
+    Result columnar = benchmark(source, true, repetitions);
+
+    cout << count << " models, " << repetitions << " repetition(s), average ms per scan" << endl;
+    char line[256];
+    snprintf(line, sizeof(line), "%-10s %12s %12s %12s %12s %10s\n", "", "findByAttr", "filterBy", "rejectBy", "range", "models");
+    cout << line;
+    print("per model", plain);
+    print("columns", columnar);
+    return 0;
+}
@@ -0,0 +1,90 @@
+//
+//  main.cpp
+//  ofxCMS journal benchmark
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; compares restoring a collection from its journal (see
+//  CMS::Journal) with parsing the full dataset, and measures the cost of journaled writes.
+//
+//  Usage: journalBenchmark [number of records] [number of writes] (default: 50000 2000)
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+
+float elapsedMs(unsigned long long startTime){
+    return (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
+
+void removeJournal(const string &path){
+    std::remove(path.c_str());
+    std::remove((path + ".snapshot").c_str());
+    std::remove((path + ".old").c_str());
+}
+
+string dataset(int count){
+    string json = "[";
+    for(int i=0; i<count; i++){
+        if(i > 0) json += ",";
+        json += "{\"_id\":{\"$oid\":\"record" + ofToString(i) + "\"},\"title\":\"Title " + ofToString(i) + "\",\"category\":\"category" + ofToString(i % 10)
+            + "\",\"body\":\"lorem ipsum dolor sit amet, consectetur adipiscing elit\",\"number\":" + ofToString(i) + "}";
+    }
+    return json + "]";
+}
+
+int main(int argc, char *argv[]){
+    int count = argc > 1 ? std::max(1, ofToInt(argv[1])) : 50000;
+    int writes = argc > 2 ? std::max(0, ofToInt(argv[2])) : 2000;
+    string path = ofToDataPath("benchmark.journal", true);
+
+    // collections log every model they destroy
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    removeJournal(path);
+
+    string json = dataset(count);
+    float parseMs, writeMs, recoveryMs;
+    unsigned int recovered;
+
+    {
+        CMS::Collection<CMS::Model> collection;
+        collection.setDestroyOnRemove(true);
+
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        collection.parse(json);
+        parseMs = elapsedMs(startTime);
+
+        // writes the initial snapshot
+        CMS::Journal<CMS::Model> journal(path);
+        journal.open(collection);
+        journal.waitForCompaction();
+
+        startTime = ofGetElapsedTimeMicros();
+        for(int i=0; i<writes; i++){
+            collection.at(i % collection.count())->set("title", "Changed title " + ofToString(i));
+        }
+        journal.sync();
+        writeMs = elapsedMs(startTime);
+    }
+
+    {
+        CMS::Collection<CMS::Model> collection;
+        collection.setDestroyOnRemove(true);
+        CMS::Journal<CMS::Model> journal(path);
+
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        journal.open(collection);
+        recoveryMs = elapsedMs(startTime);
+        recovered = collection.count();
+    }
+
+    cout << count << " records" << endl;
+    cout << "full parse:          " << parseMs << " ms" << endl;
+    cout << "recovery:            " << recoveryMs << " ms (" << recovered << " models)" << endl;
+    cout << writes << " journaled writes: " << writeMs << " ms" << endl;
+
+    removeJournal(path);
+    return 0;
+}
@@ -0,0 +1,108 @@
+//
+//  main.cpp
+//  ofxCMS parallel benchmark
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; measures how filter scans (see Collection::setParallelScan)
+//  scale with the number of threads, from a single thread up to the given maximum
+//  (doubling every step).
+//
+//  Usage: parallelBenchmark [number of models] [max threads] [repetitions] (default: 100000 8 10)
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+
+static const int CATEGORIES = 50;
+
+void populate(CMS::Collection<CMS::Model> &collection, int count){
+    vector<CMS::Model*> models;
+    for(int i=0; i<count; i++){
+        CMS::Model *model = new CMS::Model();
+        model->set("id", ofToString(i));
+        model->set("category", "category" + ofToString(i % CATEGORIES));
+        model->set("year", ofToString(1950 + i % 70));
+        model->set("title", "title " + ofToString(i));
+        model->set("body", "body of record " + ofToString(i));
+        models.push_back(model);
+    }
+
+    collection.addMany(models);
+}
+
+class Result {
+public:
+    Result() : findMs(0.0f), filterMs(0.0f), rejectMs(0.0f), rangeMs(0.0f){}
+    float findMs, filterMs, rejectMs, rangeMs;
+};
+
+float elapsedMs(unsigned long long startTime){
+    return (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
+
+Result benchmark(CMS::Collection<CMS::Model> &collection, unsigned int threads, int repetitions){
+    CMS::ThreadPool pool(threads);
+    // every scan is big enough
+    collection.setParallelScan(&pool, 1);
+
+    // none of the scans match (or remove) anything, so they can be repeated on the same
+    // models and only the predicate evaluation is measured
+    vector<string> categories;
+    for(int i=0; i<CATEGORIES; i++) categories.push_back("category" + ofToString(i));
+
+    Result result;
+
+    for(int r=0; r<repetitions; r++){
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        collection.findByAttr("category", "none");
+        result.findMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterBy("category", categories);
+        result.filterMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.rejectBy("category", "none");
+        result.rejectMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterByRange("year", 1900, 2100);
+        result.rangeMs += elapsedMs(startTime);
+    }
+
+    collection.setParallelScan(NULL);
+
+    result.findMs /= repetitions;
+    result.filterMs /= repetitions;
+    result.rejectMs /= repetitions;
+    result.rangeMs /= repetitions;
+    return result;
+}
+
+int main(int argc, char *argv[]){
+    int count = argc > 1 ? std::max(1, ofToInt(argv[1])) : 100000;
+    unsigned int maxThreads = argc > 2 ? std::max(1, ofToInt(argv[2])) : 8;
+    int repetitions = argc > 3 ? std::max(1, ofToInt(argv[3])) : 10;
+
+    // collections log every model they destroy
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    CMS::Collection<CMS::Model> collection;
+    collection.setDestroyOnRemove(true);
+    populate(collection, count);
+
+    cout << count << " models, " << repetitions << " repetition(s), " << std::thread::hardware_concurrency() << " hardware thread(s), average ms per scan" << endl;
+    char line[256];
+    snprintf(line, sizeof(line), "%-8s %12s %12s %12s %12s\n", "threads", "findByAttr", "filterBy", "rejectBy", "range");
+    cout << line;
+
+    for(unsigned int threads=1; threads<=maxThreads; threads*=2){
+        Result result = benchmark(collection, threads, repetitions);
+        snprintf(line, sizeof(line), "%-8u %12.3f %12.3f %12.3f %12.3f\n", threads, result.findMs, result.filterMs, result.rejectMs, result.rangeMs);
+        cout << line;
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+//
+//  main.cpp
+//  ofxCMS schema benchmark
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; compares models with a typed schema (see SchemaModel) against
+//  plain models holding the same records: parsing, reading fields (get<F>() against get()
+//  plus a conversion) and filter scans (the typed filterBy<F>/filterByRange<F>/rejectBy<F>
+//  against their string versions).
+//
+//  Usage: schemaBenchmark [number of models] [repetitions] (default: 50000 10)
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+
+CMS_FIELD(Title, "title", string);
+CMS_FIELD(Year, "year", int);
+CMS_FIELD(Score, "score", double);
+CMS_FIELD(Live, "live", bool);
+
+class Record : public CMS::SchemaModel<Title, Year, Score, Live> {};
+
+string generateJson(int count){
+    string json = "[";
+    for(int i=0; i<count; i++){
+        if(i > 0) json += ",";
+        json += "{\"_id\":{\"$oid\":\"" + ofToString(i) + "\"},\"title\":\"title " + ofToString(i) + "\",\"year\":" + ofToString(1950 + i % 70)
+            + ",\"score\":" + ofToString(i % 1000) + ".5,\"live\":" + (i % 2 ? "true" : "false") + ",\"body\":\"body of record " + ofToString(i) + "\"}";
+    }
+    return json + "]";
+}
+
+class Result {
+public:
+    Result() : parseMs(0.0f), intReadMs(0.0f), stringReadMs(0.0f), filterMs(0.0f), rangeMs(0.0f), rejectMs(0.0f), checksum(0){}
+    float parseMs, intReadMs, stringReadMs, filterMs, rangeMs, rejectMs;
+    long long checksum;
+};
+
+float elapsedMs(unsigned long long startTime){
+    return (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+}
+
+Result benchmarkPlain(const string &json, int repetitions){
+    Result result;
+    CMS::Collection<CMS::Model> collection;
+    collection.setDestroyOnRemove(true);
+
+    unsigned long long startTime = ofGetElapsedTimeMicros();
+    collection.parse(json);
+    result.parseMs = elapsedMs(startTime);
+
+    const vector<CMS::Model*> &models = collection.models();
+    vector<string> liveValues;
+    liveValues.push_back("true");
+    liveValues.push_back("false");
+
+    for(int r=0; r<repetitions; r++){
+        startTime = ofGetElapsedTimeMicros();
+        for(size_t i=0; i<models.size(); i++) result.checksum += ofToInt(models[i]->get("year"));
+        result.intReadMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        for(size_t i=0; i<models.size(); i++) result.checksum += models[i]->get("title").size();
+        result.stringReadMs += elapsedMs(startTime);
+
+        // none of the scans match (or remove) anything, so they can be repeated
+        // on the same models and only the predicate evaluation is measured
+        startTime = ofGetElapsedTimeMicros();
+        collection.rejectBy("year", "1900");
+        result.rejectMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterByRange("year", 1900, 2100);
+        result.rangeMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterBy("live", liveValues);
+        result.filterMs += elapsedMs(startTime);
+    }
+
+    return result;
+}
+
+Result benchmarkTyped(const string &json, int repetitions){
+    Result result;
+    CMS::Collection<Record> collection;
+    collection.setDestroyOnRemove(true);
+
+    unsigned long long startTime = ofGetElapsedTimeMicros();
+    collection.parse(json);
+    result.parseMs = elapsedMs(startTime);
+
+    const vector<Record*> &models = collection.models();
+
+    for(int r=0; r<repetitions; r++){
+        startTime = ofGetElapsedTimeMicros();
+        for(size_t i=0; i<models.size(); i++) result.checksum += models[i]->get<Year>();
+        result.intReadMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        for(size_t i=0; i<models.size(); i++) result.checksum += models[i]->get<Title>().size();
+        result.stringReadMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.rejectBy<Year>(1900);
+        result.rejectMs += elapsedMs(startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterByRange<Year>(1900, 2100);
+        result.rangeMs += elapsedMs(startTime);
+
+        // every model is either live or not (filterBy("live", liveValues) for plain models)
+        startTime = ofGetElapsedTimeMicros();
+        collection.filterByRange<Live>(false, true);
+        result.filterMs += elapsedMs(startTime);
+    }
+
+    return result;
+}
+
+void print(const string &name, Result result, int repetitions){
+    char line[256];
+    snprintf(line, sizeof(line), "%-8s %10.2f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name.c_str(), result.parseMs, result.intReadMs / repetitions,
+        result.stringReadMs / repetitions, result.rejectMs / repetitions, result.rangeMs / repetitions, result.filterMs / repetitions);
+    cout << line;
+}
+
+int main(int argc, char *argv[]){
+    int count = argc > 1 ? std::max(1, ofToInt(argv[1])) : 50000;
+    int repetitions = argc > 2 ? std::max(1, ofToInt(argv[2])) : 10;
+
+    // collections log every model they destroy
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    string json = generateJson(count);
+    Result plain = benchmarkPlain(json, repetitions);
+    Result typed = benchmarkTyped(json, repetitions);
+
+    if(plain.checksum != typed.checksum){
+        cout << "checksum mismatch: " << plain.checksum << " (plain) != " << typed.checksum << " (typed)" << endl;
+        return 1;
+    }
+
+    cout << count << " models, " << repetitions << " repetition(s); parse ms, average ms per pass" << endl;
+    char line[256];
+    snprintf(line, sizeof(line), "%-8s %10s %10s %10s %10s %10s %10s\n", "", "parse", "int read", "str read", "reject", "range", "bool");
+    cout << line;
+    print("plain", plain, repetitions);
+    print("schema", typed, repetitions);
+    return 0;
+}
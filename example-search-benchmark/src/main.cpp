@@ -0,0 +1,148 @@
+//
+//  main.cpp
+//  ofxCMS search benchmark
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; measures keystroke latency of Collection::search (see
+//  CMS::SearchIndex) against scanning every model's title and body, for a query that is
+//  typed one letter at a time.
+//
+//  Usage: searchBenchmark [number of models ...] (default: 10000 100000)
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+#include <random>
+
+static const char *QUERY = "museum gal";
+static const int WORDS_PER_MODEL = 9;
+static const int VOCABULARY_SIZE = 5000;
+static const int RESULT_LIMIT = 20;
+
+// pronounceable made up words, plus the ones we're looking for
+vector<string> vocabulary(std::mt19937 &random){
+    static const char *syllables[] = {"ka", "mu", "se", "um", "gal", "le", "ry", "to", "ni", "ar", "po", "den", "vi", "sto", "ra", "bel"};
+    std::uniform_int_distribution<int> syllable(0, 15), length(1, 4);
+
+    vector<string> words;
+    words.push_back("museum");
+    words.push_back("gallery");
+
+    while((int)words.size() < VOCABULARY_SIZE){
+        string word;
+        for(int i=length(random); i>0; i--) word += syllables[syllable(random)];
+        words.push_back(word);
+    }
+
+    return words;
+}
+
+void populate(CMS::Collection<CMS::Model> &collection, int count, std::mt19937 &random){
+    vector<string> words = vocabulary(random);
+    std::uniform_int_distribution<int> word(0, words.size()-1);
+
+    vector<CMS::Model*> models;
+    for(int i=0; i<count; i++){
+        string title, body;
+        for(int w=0; w<WORDS_PER_MODEL; w++){
+            string &text = w < 3 ? title : body;
+            if(!text.empty()) text += ' ';
+            text += words[word(random)];
+        }
+
+        CMS::Model *model = new CMS::Model();
+        model->set("id", ofToString(i));
+        model->set("title", title);
+        model->set("body", body);
+        models.push_back(model);
+    }
+
+    collection.addMany(models);
+}
+
+// what the kiosk used to do on every keystroke; every model has to be checked (and ranking
+// the matches would come on top of this)
+vector<CMS::Model*> scan(CMS::Collection<CMS::Model> &collection, const string &query){
+    vector<string> terms = CMS::SearchIndex<CMS::Model>::tokenize(query);
+    vector<CMS::Model*> result;
+
+    for(unsigned int i=0; i<collection.count(); i++){
+        CMS::Model *model = collection.at(i);
+        string text = ofToLower(model->get("title") + " " + model->get("body"));
+
+        bool match = true;
+        for(size_t t=0; t<terms.size() && match; t++){
+            match = text.find(terms[t]) != string::npos;
+        }
+
+        if(match) result.push_back(model);
+    }
+
+    return result;
+}
+
+void benchmark(int count){
+    std::mt19937 random(count);
+    CMS::Collection<CMS::Model> collection;
+    collection.setDestroyOnRemove(true);
+    populate(collection, count, random);
+
+    unsigned long long startTime = ofGetElapsedTimeMicros();
+    vector<string> attrs;
+    attrs.push_back("title");
+    attrs.push_back("body");
+    collection.searchIndex(attrs);
+    float indexMs = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+
+    cout << count << " models (indexing took " << indexMs << "ms)" << endl;
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s %12s %8s %12s %8s\n", "query", "index ms", "top", "scan ms", "matches");
+    cout << line;
+
+    string query = QUERY;
+    float indexTotal = 0.0f, scanTotal = 0.0f;
+
+    for(size_t i=1; i<=query.size(); i++){
+        string typed = query.substr(0, i);
+        if(typed[typed.size()-1] == ' ') continue;
+
+        startTime = ofGetElapsedTimeMicros();
+        unsigned int found = collection.search(typed, RESULT_LIMIT).size();
+        float indexMs = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+
+        startTime = ofGetElapsedTimeMicros();
+        unsigned int scanned = scan(collection, typed).size();
+        float scanMs = (ofGetElapsedTimeMicros() - startTime) / 1000.0f;
+
+        indexTotal += indexMs;
+        scanTotal += scanMs;
+
+        snprintf(line, sizeof(line), "%-12s %12.2f %8u %12.2f %8u\n", ("'" + typed + "'").c_str(), indexMs, found, scanMs, scanned);
+        cout << line;
+    }
+
+    snprintf(line, sizeof(line), "%-12s %12.2f %8s %12.2f\n\n", "total", indexTotal, "", scanTotal);
+    cout << line;
+}
+
+int main(int argc, char *argv[]){
+    // collections log every model they destroy
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    vector<int> counts;
+    for(int i=1; i<argc; i++) counts.push_back(std::max(1, ofToInt(argv[i])));
+
+    if(counts.empty()){
+        counts.push_back(10000);
+        counts.push_back(100000);
+    }
+
+    for(size_t i=0; i<counts.size(); i++){
+        benchmark(counts[i]);
+    }
+
+    return 0;
+}
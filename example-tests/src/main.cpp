@@ -0,0 +1,200 @@
+//
+//  main.cpp
+//  ofxCMS tests
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless test runner; prints every failed check and returns the number of failures.
+//
+//  Usage: tests
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// count every allocation made by the process
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size){
+    allocations++;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if(ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if(!(condition)){ \
+        failures++; \
+        cout << __FUNCTION__ << ":" << __LINE__ << " failed: " << #condition << endl; \
+    }
+
+// allocations made by the given function
+template<class Function>
+unsigned long long countAllocations(Function function){
+    unsigned long long before = allocations.load();
+    function();
+    return allocations.load() - before;
+}
+
+// lookup, attrEquals and the collection scans built on them shouldn't allocate
+void testNonAllocatingLookups(){
+    CMS::Collection<CMS::Model> collection;
+    string json = "[";
+    for(int i=0; i<1000; i++){
+        if(i > 0) json += ",";
+        json += "{\"id\":\"" + ofToString(i) + "\",\"category\":\"category" + ofToString(i % 10) + "\",\"title\":\"title number " + ofToString(i) + "\"}";
+    }
+    collection.parse(json + "]");
+
+    CMS::Model *model = collection.findById("500");
+    CHECK(model != NULL);
+    if(model == NULL) return;
+
+    const string id = "500", title = "title", missing = "missing", category = "category", value = "title number 500";
+    const string none = "none";
+    vector<string> categories;
+    for(int i=0; i<10; i++) categories.push_back("category" + ofToString(i));
+
+    CHECK(countAllocations([&](){ model->lookup(title); }) == 0);
+    CHECK(countAllocations([&](){ model->lookup(missing); }) == 0);
+    CHECK(countAllocations([&](){ model->attrEquals(title, value); }) == 0);
+    CHECK(countAllocations([&](){ model->attrEquals(missing, value); }) == 0);
+    CHECK(countAllocations([&](){ model->id(); }) == 0);
+    CHECK(countAllocations([&](){ collection.findById(id); }) == 0);
+    CHECK(countAllocations([&](){ collection.findByAttr(title, none); }) == 0);
+
+    // the first scan sizes the collection's scan buffer; none of these remove anything
+    collection.rejectBy(category, none);
+    CHECK(countAllocations([&](){ collection.rejectBy(category, none); }) == 0);
+    CHECK(countAllocations([&](){ collection.filterBy(category, categories); }) == 0);
+    CHECK(countAllocations([&](){ collection.rejectBy(title, none); }) == 0);
+    CHECK(collection.count() == 1000);
+
+    collection.filterBy(category, "category1");
+    CHECK(collection.count() == 100);
+    CHECK(countAllocations([&](){ collection.filterBy(category, "category1"); }) == 0);
+}
+
+// a spilled model that leaves the collection mustn't be spilled again by a later enforce()
+void testSpilledModelRemoval(){
+    CMS::Collection<CMS::Model> collection;
+    collection.setDestroyOnRemove(true);
+    CMS::MemoryBudget<CMS::Model> &budget = collection.setMemoryBudget(4000, ofToDataPath("tests.spill", true));
+
+    string json = "[";
+    for(int i=0; i<100; i++){
+        if(i > 0) json += ",";
+        json += "{\"_id\":{\"$oid\":\"" + ofToString(i) + "\"},\"title\":\"title number " + ofToString(i) + " lorem ipsum dolor sit amet\"}";
+    }
+    collection.parse(json + "]");
+    CHECK(budget.spilledCount() > 0);
+
+    // the least recently used models are the first ones
+    collection.remove(collection.findById("0"));
+    collection.destroy(collection.findById("1"));
+    CHECK(collection.count() == 98);
+
+    // spill (nearly) everything
+    budget.setBudget(100);
+    CHECK(budget.spilledCount() <= collection.count());
+    CHECK(collection.findById("2")->get("title") == "title number 2 lorem ipsum dolor sit amet");
+    CHECK(collection.findById("99")->get("title") == "title number 99 lorem ipsum dolor sit amet");
+}
+
+// a model that no longer passes an active filter is removed (and destroyed) while it's
+// being changed; set() mustn't touch it after that, deferred or not
+void testDestroyedBySet(){
+    for(int deferred=0; deferred<2; deferred++){
+        CMS::EventQueue::current().setDeferred(deferred == 1);
+
+        CMS::Collection<CMS::Model> collection;
+        collection.setDestroyOnRemove(true);
+        collection.filtersBy("type", "a");
+
+        CMS::Model *model = new CMS::Model();
+        model->set("id", "1");
+        model->set("type", "a");
+        collection.add(model);
+        CHECK(collection.count() == 1);
+
+        model->set("type", "b");
+        CHECK(collection.count() == 0);
+
+        CMS::EventQueue::current().setDeferred(false);
+    }
+}
+
+// changes an attribute again, from an attributeChangedEvent listener
+class Resetter {
+public:
+    string attr, from, to;
+    void onAttributeChanged(CMS::AttrChangeArgs &args){
+        if(args.attr == attr && args.value == from) args.model->set(attr, to);
+    }
+};
+
+void testNestedChanges(){
+    for(int deferred=0; deferred<2; deferred++){
+        CMS::EventQueue::current().setDeferred(deferred == 1);
+
+        CMS::Collection<CMS::Model> collection;
+        vector<string> attrs;
+        attrs.push_back("type");
+        collection.columns(attrs);
+        collection.facet("type");
+
+        CMS::Model *model = new CMS::Model();
+        model->set("_id", "1");
+        model->set("type", "a");
+        collection.add(model);
+
+        Resetter typeResetter, idResetter;
+        typeResetter.attr = "type"; typeResetter.from = "b"; typeResetter.to = "c";
+        idResetter.attr = "_id"; idResetter.from = "2"; idResetter.to = "3";
+        ofAddListener(model->attributeChangedEvent, &typeResetter, &Resetter::onAttributeChanged);
+        ofAddListener(model->attributeChangedEvent, &idResetter, &Resetter::onAttributeChanged);
+
+        model->set("type", "b");
+        model->set("_id", "2");
+        CMS::EventQueue::current().flush();
+
+        CHECK(model->get("type") == "c");
+        CHECK(collection.facet("type").count("c") == 1);
+        CHECK(collection.facet("type").count("b") == 0);
+        CHECK(collection.findByAttr("type", "c") == model);
+        CHECK(collection.findByAttr("type", "b") == NULL);
+        CHECK(collection.findById("3") == model);
+        CHECK(collection.findById("2") == NULL);
+
+        // filters on columns go through the column store
+        collection.filterBy("type", "c");
+        CHECK(collection.count() == 1);
+
+        ofRemoveListener(model->attributeChangedEvent, &typeResetter, &Resetter::onAttributeChanged);
+        ofRemoveListener(model->attributeChangedEvent, &idResetter, &Resetter::onAttributeChanged);
+        CMS::EventQueue::current().setDeferred(false);
+    }
+}
+
+int main(){
+    // collections log things like removed models
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    testNonAllocatingLookups();
+    testSpilledModelRemoval();
+    testDestroyedBySet();
+    testNestedChanges();
+
+    cout << (failures == 0 ? "all tests passed" : ofToString(failures) + " check(s) failed") << endl;
+    return failures;
+}
@@ -0,0 +1,63 @@
+//
+//  main.cpp
+//  ofxCMS trace replay
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+//  Headless benchmark tool; replays a trace recorded with CMS::TraceRecorder and prints
+//  latency percentiles and allocation counts per operation.
+//
+//  Usage: traceReplay <trace file> [repetitions]
+//
+
+#include "ofMain.h"
+#include "CMS.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// count every allocation made by the process
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size){
+    allocations++;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if(ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        cout << "usage: " << argv[0] << " <trace file> [repetitions]" << endl;
+        return 1;
+    }
+
+    string path = argv[1];
+    int repetitions = argc > 2 ? std::max(1, ofToInt(argv[2])) : 1;
+
+    // collections log things like limit evictions, which would end up in the measurements
+    ofSetLogLevel(OF_LOG_WARNING);
+
+    CMS::TraceReplayer<CMS::Model> replayer;
+    if(!replayer.load(path)){
+        cout << "couldn't load trace: " << path << endl;
+        return 1;
+    }
+
+    replayer.setAllocationCounter([](){ return allocations.load(); });
+
+    unsigned long long startTime = ofGetElapsedTimeMicros();
+    for(int i=0; i<repetitions; i++){
+        replayer.replay();
+    }
+    float seconds = (ofGetElapsedTimeMicros() - startTime) / 1000000.0f;
+
+    cout << replayer.ops().size() << " operations, " << repetitions << " repetition(s), " << seconds << "s" << endl;
+    cout << replayer.report();
+    return 0;
+}
@@ -10,6 +10,20 @@
 #define __BaseApp__CMS__
 
 #include "CMSModel.h"
+#include "CMSSchema.h"
+#include "CMSIdentityMap.h"
+#include "CMSIndex.h"
+#include "CMSThreadPool.h"
+#include "CMSFacet.h"
+#include "CMSSearchIndex.h"
+#include "CMSMemoryBudget.h"
+#include "CMSColumnStore.h"
+#include "CMSLazySource.h"
+#include "CMSTrace.h"
+#include "CMSEventQueue.h"
 #include "CMSCollection.h"
+#include "CMSJournal.h"
+#include "CMSTraceReplayer.h"
+#include "CMSSharedCollection.h"
 
 #endif /* defined(__BaseApp__CMS__) */
@@ -15,6 +15,16 @@
 // Even though CMS::Collection is a template class,
 // it does assume that any used model-type inherits from CMS::Model
 #include "CMSModel.h"
+#include "CMSIdentityMap.h"
+#include "CMSIndex.h"
+#include "CMSFacet.h"
+#include "CMSSearchIndex.h"
+#include "CMSMemoryBudget.h"
+#include "CMSThreadPool.h"
+#include "CMSColumnStore.h"
+#include "CMSLazySource.h"
+#include "CMSTrace.h"
+#include "CMSEventQueue.h"
 
 namespace CMS {
 
@@ -26,6 +36,89 @@ namespace CMS {
     #define SAME_MODEL(a,b) (a == b)
     #define MODELS_MATCH(a,b) (a->id() == b->id())
 
+    // summary of what a Collection::parse call changed, so callers can refresh only
+    // what's affected. All vectors hold model ids.
+    class ParseDiff {
+    public:
+        vector<string> added;
+        vector<string> updated;
+        vector<string> removed;
+        vector<string> unchanged;
+
+        void clear(){
+            added.clear();
+            updated.clear();
+            removed.clear();
+            unchanged.clear();
+        }
+
+        bool empty(){ return added.empty() && updated.empty() && removed.empty(); }
+    };
+
+    // statistics of a Collection::applyChanges call
+    class ChangeFeedResult {
+    public:
+        ChangeFeedResult() : upserted(0), deleted(0), skipped(0), offset(0), recordsPerSecond(0.0f){}
+
+        unsigned int upserted;
+        unsigned int deleted;
+        // records that were invalid, or didn't make it into the collection (filters/limit)
+        unsigned int skipped;
+        // byte offset in the feed right after the last record that was processed;
+        // pass this to the next applyChanges call to resume where we left off
+        size_t offset;
+        float recordsPerSecond;
+    };
+
+    // local changes of a collection since its last commit() (see Collection::setChangeTracking);
+    // added models with all of their attributes, updated models with only their changed
+    // attributes and the ids of removed models
+    class ChangeSet {
+    public:
+        map<string, map<string, string> > added;
+        map<string, map<string, string> > updated;
+        vector<string> removed;
+
+        void clear(){
+            added.clear();
+            updated.clear();
+            removed.clear();
+        }
+
+        bool empty(){ return added.empty() && updated.empty() && removed.empty(); }
+
+        // serializes the changes in the change feed format of Collection::applyChanges
+        // (JSON Lines; deletes first, then upserts)
+        string toJson(){
+            string lines;
+
+            for(int i=0; i<removed.size(); i++){
+                ofxJSONElement record;
+                record["op"] = "delete";
+                record["id"] = removed[i];
+                lines += record.getRawString(false) + "\n";
+            }
+
+            appendUpserts(added, lines);
+            appendUpserts(updated, lines);
+            return lines;
+        }
+
+    protected:
+        void appendUpserts(map<string, map<string, string> > &models, string &lines){
+            for(map<string, map<string, string> >::iterator it = models.begin(); it != models.end(); it++){
+                ofxJSONElement record;
+                record["op"] = "upsert";
+                record["id"] = it->first;
+                record["attrs"] = Json::Value(Json::objectValue);
+                for(map<string, string>::iterator ait = it->second.begin(); ait != it->second.end(); ait++){
+                    record["attrs"][ait->first] = ait->second;
+                }
+                lines += record.getRawString(false) + "\n";
+            }
+        }
+    };
+
     // Collection class that manages a collections of Models,
     // kinda based on the Backbone.js Collection
     template<class ModelClass>
@@ -35,8 +128,9 @@ namespace CMS {
 
         const static int NO_LIMIT = -1;
         const static int INVALID_INDEX = -1;
+        const static unsigned int DEFAULT_PARALLEL_THRESHOLD = 10000;
 
-        Collection() : _syncSource(NULL), mLimit(NO_LIMIT), bFIFO(false), bDestroyOnRemove(false){}
+        Collection() : _syncSource(NULL), _identityMap(NULL), _searchIndex(NULL), _memoryBudget(NULL), _columnStore(NULL), _lazySource(NULL), _threadPool(NULL), mParallelThreshold(DEFAULT_PARALLEL_THRESHOLD), mLimit(NO_LIMIT), bFIFO(false), bDestroyOnRemove(false), bChangeTracking(false), bIngesting(false), bVerbatimStrings(false), bLazyParsing(false), _traceRecorder(NULL){}
         ~Collection();
 
         void initialize(vector< map<string, string> > &_data);
@@ -44,6 +138,13 @@ namespace CMS {
         bool add(ModelClass *model, bool notify = true);
         ModelClass* remove(ModelClass *model, bool doDestroy = true);
         ModelClass* remove(int index, bool doDestroy = true);
+
+        // batch versions of add/remove; these fire a single modelsAddedEvent/modelsRemovedEvent
+        // for the whole batch, instead of a modelAddedEvent/modelRemovedEvent per model.
+        // addMany returns the number of added models and (optionally) gives the models that
+        // didn't make it into the collection (filters/limit), removeMany matches on pointer
+        unsigned int addMany(const vector<ModelClass*> &models, bool notify = true, vector<ModelClass*> *rejected = NULL);
+        void removeMany(const vector<ModelClass*> &models, bool doDestroy = true);
         void destroy(int index);
         void destroy(ModelClass *model);
         void destroyBy(const string &key, const string &value);
@@ -68,6 +169,9 @@ namespace CMS {
         void stopSyncing();
 
         void limit(int amount){
+            traceConfig(amount);
+            // removals are part of the limit call
+            TraceRecorder::Scope trace(_traceRecorder);
             // apply limit to current collection
             while(_models.size() > amount){
                 remove(at(_models.size()-1));
@@ -80,12 +184,81 @@ namespace CMS {
             return mLimit != NO_LIMIT && _models.size() >= mLimit;
         }
 
-        void setFifo(bool fifo){ bFIFO = fifo; }
+        void setFifo(bool fifo){ bFIFO = fifo; traceConfig(mLimit); }
         bool getFifo(){ return bFIFO; }
 
-        void setDestroyOnRemove(bool enable = true){ bDestroyOnRemove = enable; }
+        void setDestroyOnRemove(bool enable = true){ bDestroyOnRemove = enable; traceConfig(mLimit); }
         bool getDestroyOnRemove(){ return bDestroyOnRemove; }
 
+        // share model instances (by id) with other collections using the same identity map;
+        // parse() and merge() re-use registered models instead of creating duplicates
+        // and models are only destroyed when the last collection that holds them lets go
+        void setIdentityMap(IdentityMap<ModelClass> *identityMap);
+        IdentityMap<ModelClass>* getIdentityMap(){ return _identityMap; }
+
+        // attach a structure that should be kept up-to-date with this collection's
+        // content (the collection does NOT take ownership)
+        void addIndex(Index<ModelClass> *index);
+        void removeIndex(Index<ModelClass> *index);
+
+        // value counts for the given attribute, maintained incrementally while models
+        // are added, removed or changed. Created on first use, owned by the collection
+        Facet<ModelClass> &facet(const string &attr, bool trackModels = false);
+        void removeFacet(const string &attr);
+
+        // full-text (prefix) search index over the given attributes, maintained incrementally.
+        // Created on first use (or re-created when the attributes differ), owned by the collection
+        SearchIndex<ModelClass> &searchIndex(const vector<string> &attrs);
+        void removeSearchIndex();
+        // searches using the search index; returns nothing when there's no search index
+        vector<ModelClass*> search(const string &query, unsigned int limit = 0){
+            return _searchIndex ? _searchIndex->search(query, limit) : vector<ModelClass*>();
+        }
+
+        // limit the (approximate) memory used by our models' attributes to the given number
+        // of bytes; the attributes of the least recently accessed models are moved to the
+        // given spill file and loaded back when accessed. Owned by the collection
+        MemoryBudget<ModelClass> &setMemoryBudget(size_t bytes, const string &spillPath);
+        MemoryBudget<ModelClass>* getMemoryBudget(){ return _memoryBudget; }
+        // loads all spilled attributes back into memory
+        void removeMemoryBudget();
+
+        // evaluate filterBy/rejectBy/destroyBy/findByAttr predicates on the given thread pool
+        // when the collection has at least threshold models (NULL disables). Models are still
+        // removed and events are still fired on the calling thread, in the same order as before.
+        // Collections holding models with an attribute source (a memory budget or lazy parsing, also
+        // when it's another collection's, for example through an identity map or syncing) are
+        // scanned on the calling thread
+        void setParallelScan(ThreadPool *pool, unsigned int threshold = DEFAULT_PARALLEL_THRESHOLD){
+            _threadPool = pool;
+            mParallelThreshold = threshold;
+        }
+
+        // keep a columnar (dictionary-encoded/numeric) copy of the given attributes, which turns
+        // filterBy, rejectBy, destroyBy, findByAttr and filterByRange on those attributes into
+        // tight loops over integers/doubles. Owned by the collection
+        ColumnStore<ModelClass> &columns(const vector<string> &attrs);
+        void removeColumns();
+
+        // keep track of local changes (added, removed and dirty models, see Model::isDirty)
+        // since the last commit(). Models that come in through parse, applyChanges or
+        // initialize are considered to be in sync and aren't tracked. Removals by filters
+        // and limits are tracked like any other removal. Enables dirty tracking on our models;
+        // disabling change tracking leaves that on (other collections might still need it)
+        void setChangeTracking(bool enable = true);
+        bool getChangeTracking(){ return bChangeTracking; }
+        bool hasChanges(){ return !_addedModels.empty() || !_dirtyModels.empty() || !_removedIds.empty(); }
+        ChangeSet changes();
+        // marks all tracked changes as done (commits all added and dirty models)
+        void commit();
+
+        // record this collection's operations under the given name (see TraceRecorder);
+        // the collection's current settings, filters and models are recorded right away.
+        // Pass NULL to stop recording
+        void setTraceRecorder(TraceRecorder *recorder, const string &name);
+        TraceRecorder* getTraceRecorder(){ return _traceRecorder; }
+        const string &getTraceName(){ return mTraceName; }
+
         bool has(ModelClass* m){ return index(m) != INVALID_INDEX; }
         int index(ModelClass* m){
             for(int i=0; i<_models.size(); i++){
@@ -102,12 +275,42 @@ namespace CMS {
                 _models.pop_back(); // remove the last one
                 _models.insert(_models.begin() + ofRandom(_models.size()), tmp); // insert at random position
             }
+
+            if(_columnStore) _columnStore->invalidate();
         }
     public: // parsing methods
 
-        bool parse(const string &jsonText, bool doRemove = true, bool doUpdate = true, bool doCreate = true);
-        bool parse(const ofxJSONElement & node, bool doRemove = true, bool doUpdate = true, bool doCreate = true);
+        // when a diff pointer is given, it is filled with a summary of the applied changes
+        bool parse(const string &jsonText, bool doRemove = true, bool doUpdate = true, bool doCreate = true, ParseDiff *diff = NULL);
+        bool parse(const ofxJSONElement & node, bool doRemove = true, bool doUpdate = true, bool doCreate = true, ParseDiff *diff = NULL);
         void parseModelJson(ModelClass *model, const string &jsonText);
+        void parseModelJson(ModelClass *model, Json::Value &node);
+
+        // lazy parsing; parse() only decodes the ids and the eager attributes of new records
+        // and the rest of their attributes on first access (of any other attribute). Eager are
+        // the given attributes, plus the attributes used by active filters, facets, columns and
+        // the search index at the time of parsing. Records are checked for well-formedness on
+        // first access, and a model that's still waiting to be decoded keeps the whole json
+        // text in memory. Updates of existing models are still decoded right away.
+        //
+        // A model has a single attribute source, so lazy models can't be managed by a memory
+        // budget; collections with a memory budget parse (and setMemoryBudget decodes) everything
+        // right away. Indexes that read all attributes of the models they index (like a Journal,
+        // which writes the full records) decode the models as they're added, which defeats the purpose
+        void setLazyParsing(bool enable, const vector<string> &eagerAttrs = vector<string>()){
+            bLazyParsing = enable;
+            _eagerAttrs = eagerAttrs;
+            traceConfig(mLimit);
+        }
+        bool getLazyParsing(){ return bLazyParsing; }
+
+        // incrementally apply a change feed in JSON Lines format, one record per line:
+        //   {"op": "upsert", "id": "...", "attrs": {...}}
+        //   {"op": "delete", "id": "..."}
+        // upserts update the attributes of an existing model (only the given attributes)
+        // or create a new one (subject to active filters and limit), deletes destroy the model.
+        // Processing starts at the given byte offset; an incomplete last line is left for the next call
+        ChangeFeedResult applyChanges(const string &jsonLines, size_t offset = 0);
 
         // "merge" all models of another collection into our own collection.
         // for each model in the other collection, it will try to find an existing
@@ -116,6 +319,13 @@ namespace CMS {
         // a new model is created with the attributes of the other collection's model and
         // added to our collection
         void merge(Collection<ModelClass> &otherCollection){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->merge(mTraceName, otherCollection.getTraceName());
+
+            vector<ModelClass*> newModels;
+            // models we created in this merge, by id; in case the other collection has duplicate ids
+            map<string, ModelClass*> created;
+
             // loop over other collection's models
             for(int i=0; i<otherCollection.count(); i++){
                 ModelClass* otherModel = otherCollection.at(i);
@@ -123,6 +333,9 @@ namespace CMS {
 
                 // find existing matching model in our own collection
                 ModelClass* existing = this->findById(otherModel->id());
+                if(existing == NULL && created.find(otherModel->id()) != created.end())
+                    existing = created[otherModel->id()];
+
                 if(existing){
                     // update existing model
                     existing->set(otherModel->attributes());
@@ -130,14 +343,22 @@ namespace CMS {
                     continue;
                 }
 
-                // no existing model found, create new model
-                ModelClass* newModel = new ModelClass();
+                // no existing model found, see if another collection already has it
+                ModelClass* newModel = findShared(otherModel->id());
+                // if not, create new model
+                if(newModel == NULL) newModel = new ModelClass();
                 // initialize new model with data from other model
                 newModel->set(otherModel->attributes());
-                // add it to our collection
-                if(!add(newModel)){
-                    delete newModel;
-                }
+                newModels.push_back(newModel);
+                created[otherModel->id()] = newModel;
+            }
+
+            // add all new models to our collection at once
+            vector<ModelClass*> rejected;
+            addMany(newModels, true, &rejected);
+
+            for(int i=0; i<rejected.size(); i++){
+                if(!isShared(rejected[i])) delete rejected[i];
             }
         }
 
@@ -149,9 +370,14 @@ namespace CMS {
         // One-time filter: only keep models with any of the specified values for a specific key
         void filterBy(const string &key, vector<string> &values);
 
+        // One-time filter: only keep models with a numeric value within [min, max] for a specific key
+        void filterByRange(const string &key, double min, double max);
+
         // Active Filter: only keep models with a specific key-value combination
         // and also apply this filter when new models are added
         void filtersBy(const string &attr, const string &value){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, attr, vector<string>(1, value), true, false);
             // apply filter on current collection
             filterBy(attr, value);
             // save filter to apply to newly added models
@@ -161,6 +387,8 @@ namespace CMS {
         // Active Filter: only keep models with any of the specified values for a specific key
         // and also apply this filter when new models are added
         void filtersBy(const string &attr, vector<string> &values){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, attr, values, true, false);
             // apply filter on current collection
             filterBy(attr, values);
             // save filter to apply to newly added models
@@ -169,31 +397,33 @@ namespace CMS {
 
         // One-time filter: rejection only keep models that DO NOT have a specific key-value combination
         void rejectBy(const string &key, const string &val){
-            // we have to do this backwards! because every time you remove a model,
-            // it messes with all the following index values
-            for(int i=_models.size()-1; i>=0; i--){
-                // get current model
-                ModelClass* model = at(i);
-                // remove it, if it doesn't meet the criteria
-                if(!modelPassesSingleValueRejection(model, key, val)) remove(model);
-            }
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, key, vector<string>(1, val), false, true);
+
+            ScanFlags flags(_scanFlags);
+            if(!scanColumn(key, val, flags))
+                scan([&](ModelClass* model){ return !modelPassesSingleValueRejection(model, key, val); }, flags);
+            // remove all models that don't meet the criteria
+            removeFlagged(flags);
         }
 
         // one-time multi-value rejection; all models who's attribute match any of the value are removed
         void rejectBy(const string &key, vector<string> &values){
-            // we have to do this backwards! because every time you remove a model,
-            // it messes with all the following index values
-            for(int i=_models.size()-1; i>=0; i--){
-                // get current model
-                ModelClass* model = at(i);
-                // remove it, if it doesn't meet the criteria
-                if(!modelPassesMultiValueRejection(model, key, values)) remove(model);
-            }
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, key, values, false, true);
+
+            ScanFlags flags(_scanFlags);
+            if(!scanColumn(key, values, flags))
+                scan([&](ModelClass* model){ return !modelPassesMultiValueRejection(model, key, values); }, flags);
+            // remove all models that don't meet the criteria
+            removeFlagged(flags);
         }
 
         // Active Filter: only keep models without a specific key-value combination
         // and also apply this filter when new models are added
         void rejectsBy(const string &attr, const string &value){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, attr, vector<string>(1, value), true, true);
             // apply filter on current collection
             rejectBy(attr, value);
             // save filter to apply to newly added models
@@ -203,6 +433,8 @@ namespace CMS {
         // Active Filter: only keep models without any of the specified values for a specific key
         // and also apply this filter when new models are added
         void rejectsBy(const string &attr, vector<string> &values){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->filterBy(mTraceName, attr, values, true, true);
             // apply filter on current collection
             rejectBy(attr, values);
             // save filter to apply to newly added models
@@ -210,6 +442,9 @@ namespace CMS {
         }
 
         void removeFilters(bool resync = true){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->removeFilters(mTraceName, resync);
+
             filterValues.clear();
             filterVectors.clear();
             rejectValues.clear();
@@ -223,6 +458,9 @@ namespace CMS {
         }
 
         void removeFilter(const string &attr, bool resync = true){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->removeFilter(mTraceName, attr, resync);
+
             filterValues.erase(attr);
             filterVectors.erase(attr);
             rejectValues.erase(attr);
@@ -235,6 +473,45 @@ namespace CMS {
             }
         }
 
+    public: // typed filter methods
+
+        // One-time filters and lookups on typed fields, for models with a schema (see SchemaModel);
+        // these compare the models' typed slots instead of looking up and comparing strings
+
+        template<class F>
+        void filterBy(const typename F::type &value){
+            ScanFlags flags(_scanFlags);
+            scan([&](ModelClass* model){ return !(model->template get<F>() == value); }, flags);
+            removeFlagged(flags);
+        }
+
+        template<class F>
+        void filterByRange(const typename F::type &min, const typename F::type &max){
+            ScanFlags flags(_scanFlags);
+            scan([&](ModelClass* model){
+                const typename F::type &value = model->template get<F>();
+                return value < min || max < value;
+            }, flags);
+            removeFlagged(flags);
+        }
+
+        template<class F>
+        void rejectBy(const typename F::type &value){
+            ScanFlags flags(_scanFlags);
+            scan([&](ModelClass* model){ return model->template get<F>() == value; }, flags);
+            removeFlagged(flags);
+        }
+
+        template<class F>
+        ModelClass* findBy(const typename F::type &value){
+            for(int i=0; i<_models.size(); i++){
+                if(_models[i]->template get<F>() == value)
+                    return _models[i];
+            }
+
+            return NULL;
+        }
+
     protected: // filter methods
         
         bool modelPassesActiveFilters(ModelClass* model){
@@ -256,16 +533,18 @@ namespace CMS {
         }
 
         bool modelPassesMultiValueFilter(ModelClass *model, const string &attr, vector<string> &values){
+            // look up the value once, instead of copying it out of the model for every candidate value
+            const string *value = model->lookup(attr);
             for(int i=0; i<values.size(); i++){
                 // passes if it has one of the specified values
-                if(model->get(attr) == values[i]) return true;
+                if(value ? *value == values[i] : values[i].empty()) return true;
             }
             
             return false;
         }
         
         bool modelPassesSingleValueFilter(ModelClass *model, const string &attr, const string &value){
-            return model->get(attr) == value;
+            return model->attrEquals(attr, value);
         }
 
         bool modelPassesActiveRejections(ModelClass* model){
@@ -287,56 +566,319 @@ namespace CMS {
         }
 
         bool modelPassesMultiValueRejection(ModelClass *model, const string &attr, vector<string> &values){
+            const string *value = model->lookup(attr);
             for(int i=0; i<values.size(); i++){
                 // passes if it has one of the specified values
-                if(model->get(attr) == values[i]) return false;
+                if(value ? *value == values[i] : values[i].empty()) return false;
             }
 
             return true;
         }
 
-        bool modelPassesSingleValueRejection(ModelClass *model, const string &attr, string value){
-            return model->get(attr) != value;
+        bool modelPassesSingleValueRejection(ModelClass *model, const string &attr, const string &value){
+            return !model->attrEquals(attr, value);
         }
         
+    protected: // scan methods
+
+        // scan() results; borrows the collection's buffer, so repeated scans don't allocate
+        // (nested scans, by event listeners, get a buffer of their own)
+        class ScanFlags : public vector<char>{
+        public:
+            ScanFlags(vector<char> &buffer) : _buffer(buffer){ swap(buffer); }
+            ~ScanFlags(){
+                if(capacity() <= _buffer.capacity()) return;
+                clear();
+                swap(_buffer);
+            }
+        protected:
+            vector<char> &_buffer;
+        };
+
+        // true when a scan of our models can run on our thread pool; not when any of them has an
+        // attribute source (a memory budget or lazy parsing, ours or another collection's), because
+        // accessing their attributes changes the source's state
+        bool parallelScan(){
+            if(_threadPool == NULL || _models.size() < mParallelThreshold) return false;
+
+            for(size_t i=0; i<_models.size(); i++){
+                if(_models[i]->getAttributeSource() != NULL) return false;
+            }
+
+            return true;
+        }
+
+        // evaluates the predicate for every model; flags[i] holds the result for _models[i].
+        // Runs on our thread pool for large collections (see setParallelScan); this includes
+        // the typed filters (filterBy<F>, filterByRange<F>, rejectBy<F>)
+        template<class Predicate>
+        void scan(Predicate predicate, vector<char> &flags){
+            unsigned int count = _models.size();
+            flags.resize(count);
+
+            if(parallelScan()){
+                _threadPool->parallelFor(count, [&](unsigned int begin, unsigned int end){
+                    for(unsigned int i=begin; i<end; i++)
+                        flags[i] = predicate(_models[i]) ? 1 : 0;
+                });
+                return;
+            }
+
+            for(unsigned int i=0; i<count; i++)
+                flags[i] = predicate(_models[i]) ? 1 : 0;
+        }
+
+        // the columnar version of scan(), for equality checks; flags[i] is 1 when _models[i] has
+        // one of the given values (0 when inverted). Returns false when there's no column for attr
+        bool scanColumn(const string &attr, const vector<string> &values, vector<char> &flags, bool invert = false){
+            if(_columnStore == NULL || !_columnStore->hasColumn(attr)) return false;
+            _columnStore->align(_models);
+            _columnStore->matchAny(attr, values, flags, invert);
+            return true;
+        }
+
+        bool scanColumn(const string &attr, const string &value, vector<char> &flags, bool invert = false){
+            if(_columnStore == NULL || !_columnStore->hasColumn(attr)) return false;
+            return scanColumn(attr, vector<string>(1, value), flags, invert);
+        }
+
+        // removes (or destroys) every model that was flagged by scan()
+        void removeFlagged(const vector<char> &flags, bool doDestroy = false){
+            if(std::find(flags.begin(), flags.end(), 1) == flags.end()) return;
+
+            // event listeners might modify our collection while we're at it,
+            // so we keep a copy to verify we're still removing the right model
+            vector<ModelClass*> models = _models;
+
+            // we have to do this backwards! because every time you remove a model,
+            // it messes with all the following index values
+            for(int i=flags.size()-1; i>=0; i--){
+                if(!flags[i]) continue;
+
+                ModelClass* model = models[i];
+
+                if(i < _models.size() && _models[i] == model){
+                    if(doDestroy) destroy(i); else remove(i);
+                } else if(has(model)){
+                    if(doDestroy) destroy(model); else remove(model);
+                }
+            }
+        }
+
     protected: // methods
 
         int indexByCid(const string &cid);
+
+        // change tracking bookkeeping for models entering/leaving our collection
+        void trackModel(ModelClass *model, bool added){
+            if(!bChangeTracking) return;
+
+            if(added){
+                model->setDirtyTracking(true);
+
+                // removed earlier and now back; nothing was added
+                set<string>::iterator it = _removedIds.find(model->id());
+                if(it != _removedIds.end()){
+                    _removedIds.erase(it);
+                    if(model->isDirty()) _dirtyModels.insert(model);
+                    return;
+                }
+
+                if(!bIngesting) _addedModels.insert(model);
+                else if(model->isDirty()) _dirtyModels.insert(model);
+                return;
+            }
+
+            _dirtyModels.erase(model);
+            // added and removed since the last commit; nothing happened
+            if(_addedModels.erase(model) > 0) return;
+            if(!bIngesting) _removedIds.insert(model->id());
+        }
+
         string parseModelJsonValue(Json::Value &value);
+        bool applyChange(Json::Value &record);
+
+        // id index; keeps findById from having to scan all models
+        void indexId(ModelClass *model){
+            _idIndex.insert(pair<string, ModelClass*>(model->id(), model));
+        }
+
+        void unindexId(ModelClass *model){
+            pair<typename multimap<string, ModelClass*>::iterator, typename multimap<string, ModelClass*>::iterator> range = _idIndex.equal_range(model->id());
+            for(typename multimap<string, ModelClass*>::iterator it = range.first; it != range.second; it++){
+                if(it->second == model){
+                    _idIndex.erase(it);
+                    return;
+                }
+            }
+
+            // the model's id must have changed, look for the pointer instead
+            for(typename multimap<string, ModelClass*>::iterator it = _idIndex.begin(); it != _idIndex.end(); it++){
+                if(it->second == model){
+                    _idIndex.erase(it);
+                    return;
+                }
+            }
+        }
+        unsigned long long jsonFingerprint(const Json::Value &value, unsigned long long seed = Model::FINGERPRINT_SEED);
+        bool parseLazy(const string &jsonText, bool doRemove, bool doUpdate, bool doCreate, ParseDiff *diff);
+        // decodes a record (byte range of the given text) straight into the model
+        bool parseModelJson(ModelClass *model, const string &text, const LazySource::Slice &record);
+
+        // attributes that are decoded right away when parsing lazily
+        std::shared_ptr<const set<string> > eagerAttributes(){
+            std::shared_ptr< set<string> > attrs(new set<string>(_eagerAttrs.begin(), _eagerAttrs.end()));
+            attrs->insert("id");
+            attrs->insert("_id");
+
+            for(map<string, string>::iterator it = filterValues.begin(); it != filterValues.end(); it++) attrs->insert(it->first);
+            for(map< string, vector<string> >::iterator it = filterVectors.begin(); it != filterVectors.end(); it++) attrs->insert(it->first);
+            for(map<string, string>::iterator it = rejectValues.begin(); it != rejectValues.end(); it++) attrs->insert(it->first);
+            for(map< string, vector<string> >::iterator it = rejectVectors.begin(); it != rejectVectors.end(); it++) attrs->insert(it->first);
+            for(typename map<string, Facet<ModelClass>*>::iterator it = _facets.begin(); it != _facets.end(); it++) attrs->insert(it->first);
+            if(_searchIndex) attrs->insert(_searchIndex->attrs().begin(), _searchIndex->attrs().end());
+            if(_columnStore) attrs->insert(_columnStore->attrs().begin(), _columnStore->attrs().end());
+
+            return attrs;
+        }
+
+        // returns the model registered with our identity map for the given id (if any)
+        ModelClass* findShared(const string &_id){
+            return _identityMap ? _identityMap->find(_id) : NULL;
+        }
+
+        // returns true if the model is (still) held by another collection sharing our identity map
+        bool isShared(ModelClass *model){
+            return _identityMap && _identityMap->has(model);
+        }
 
         void registerSyncCallbacks(Collection<ModelClass> &otherCollection, bool _register = true){
             if(_register){
                 ofAddListener(otherCollection.modelAddedEvent, this, &Collection<ModelClass>::onSyncSourceModelAdded);
+                ofAddListener(otherCollection.modelsAddedEvent, this, &Collection<ModelClass>::onSyncSourceModelsAdded);
                 ofAddListener(otherCollection.modelChangedEvent, this, &Collection<ModelClass>::onSyncSourceModelChanged);
                 ofAddListener(otherCollection.modelRemovedEvent, this, &Collection<ModelClass>::onSyncSourceModelRemoved);
+                ofAddListener(otherCollection.modelsRemovedEvent, this, &Collection<ModelClass>::onSyncSourceModelsRemoved);
                 ofAddListener(otherCollection.collectionDestroyingEvent, this, &Collection<ModelClass>::onSyncSourceDestroying);
             } else {
                 ofRemoveListener(otherCollection.modelAddedEvent, this, &Collection<ModelClass>::onSyncSourceModelAdded);
+                ofRemoveListener(otherCollection.modelsAddedEvent, this, &Collection<ModelClass>::onSyncSourceModelsAdded);
                 ofRemoveListener(otherCollection.modelChangedEvent, this, &Collection<ModelClass>::onSyncSourceModelChanged);
                 ofRemoveListener(otherCollection.modelRemovedEvent, this, &Collection<ModelClass>::onSyncSourceModelRemoved);
+                ofRemoveListener(otherCollection.modelsRemovedEvent, this, &Collection<ModelClass>::onSyncSourceModelsRemoved);
                 ofRemoveListener(otherCollection.collectionDestroyingEvent, this, &Collection<ModelClass>::onSyncSourceDestroying);
             }
         }
 
+        // removes the given models in a single pass (keeping the order of the remaining models)
+        // and fires a single modelsRemovedEvent; returns the models that were actually removed.
+        // Pass destroying when the caller destroys them right after (see registerModel)
+        vector<ModelClass*> removeModels(const vector<ModelClass*> &models, bool destroying);
+
+        // everything that needs to happen when a model enters/leaves our collection
+        // (apart from adding/removing it to/from _models and notifications).
+        // Leaving models that are about to be destroyed (see destroyRemoved) don't need
+        // their lazily parsed attributes, unless they're accessed before that
+        void registerModel(ModelClass* model, bool _register = true, bool destroying = false){
+            if(_register){
+                indexId(model);
+                if(_identityMap) _identityMap->retain(model);
+                for(int i=0; i<_indexes.size(); i++) _indexes[i]->indexModel(model);
+                registerModelCallbacks(model);
+                trackModel(model, true);
+            } else {
+                trackModel(model, false);
+                // models that leave take all of their attributes with them
+                if(_lazySource && !destroying) _lazySource->materialize(model);
+                registerModelCallbacks(model, false);
+                for(int i=0; i<_indexes.size(); i++) _indexes[i]->unindexModel(model);
+                unindexId(model);
+                if(_identityMap) _identityMap->release(model);
+            }
+        }
+
+        // destroys a model that was removed from our collection, unless it's
+        // still held by another collection sharing our identity map
+        bool destroyRemoved(ModelClass* model, bool verbose = true){
+            if(isShared(model)){
+                ofLogVerbose() << "Not destroying removed model (id="+model->id()+"), it's still held by another collection";
+                // it's staying around after all (see registerModel)
+                if(_lazySource) _lazySource->materialize(model);
+                return false;
+            }
+
+            if(verbose) ofLog() << "Destroying removed model (id="+model->id()+", bDestroyOnRemove=true)";
+            model->destroy();
+            if(_lazySource) _lazySource->release(model);
+            delete model;
+            return true;
+        }
+
         void registerModelCallbacks(ModelClass* model, bool _register = true){
             if(_register){
                 // when a models (self-)destructs, we gotta remove it from our collection,
                 // otherwise we end up with invalid pointers
                 ofAddListener(model->beforeDestroyEvent, this, &Collection<ModelClass>::onModelDestroying);
-                ofAddListener(model->attributeChangedEvent, this, &Collection<ModelClass>::onModelAttributeChanged);
+                // the immediate version; our filters and indexes can't wait for deferred events
+                ofAddListener(model->immediateAttributeChangedEvent, this, &Collection<ModelClass>::onModelAttributeChanged);
             } else {
-                ofRemoveListener(model->attributeChangedEvent, this, &Collection<ModelClass>::onModelAttributeChanged);
+                ofRemoveListener(model->immediateAttributeChangedEvent, this, &Collection<ModelClass>::onModelAttributeChanged);
                 ofRemoveListener(model->beforeDestroyEvent, this, &Collection<ModelClass>::onModelDestroying);
             }
         }
 
+        // records our current settings (with the given limit), unless we're inside another recorded call
+        void traceConfig(int limit){
+            TraceRecorder::Scope trace(_traceRecorder);
+            if(trace.record()) _traceRecorder->collection(mTraceName, bFIFO, bDestroyOnRemove, bLazyParsing, limit, _eagerAttrs);
+        }
+
+        // notifies listeners, or queues the notification when the current thread's EventQueue is deferring.
+        // Whatever listeners do with collections is recorded as separate operations (see TraceRecorder)
+        void notifyListeners(ofEvent<ModelClass> &event, ModelClass &model){
+            TraceRecorder::Listeners listeners(_traceRecorder);
+            EventQueue *queue = EventQueue::deferring();
+            if(queue) queue->postModel(event, model, this);
+            else ofNotifyEvent(event, model, this);
+        }
+
+        void notifyListeners(ofEvent< vector<ModelClass*> > &event, vector<ModelClass*> &models){
+            TraceRecorder::Listeners listeners(_traceRecorder);
+            EventQueue *queue = EventQueue::deferring();
+            if(queue) queue->postModels(event, models, this);
+            else ofNotifyEvent(event, models, this);
+        }
+
+        void notifyListeners(ofEvent<AttrChangeArgs> &event, AttrChangeArgs &args){
+            TraceRecorder::Listeners listeners(_traceRecorder);
+            EventQueue *queue = EventQueue::deferring();
+            if(queue) queue->postChange(event, args, this);
+            else ofNotifyEvent(event, args, this);
+        }
+
+        void notifyListeners(ofEvent< Collection<ModelClass> > &event){
+            TraceRecorder::Listeners listeners(_traceRecorder);
+            EventQueue *queue = EventQueue::deferring();
+            if(queue) queue->postSender(event, this);
+            else ofNotifyEvent(event, *this, this);
+        }
+
+        void notifyListeners(ofEvent<void> &event){
+            TraceRecorder::Listeners listeners(_traceRecorder);
+            EventQueue *queue = EventQueue::deferring();
+            if(queue) queue->post(event, this);
+            else ofNotifyEvent(event, this);
+        }
+
     protected: // callbacks
         
         // NOTE: Model& type, not ModelClass& (see comments at implementation)
         void onModelDestroying(Model& model);
         void onSyncSourceModelAdded(ModelClass &m);
+        void onSyncSourceModelsAdded(vector<ModelClass*> &models);
         void onSyncSourceModelChanged(AttrChangeArgs &args);
         void onSyncSourceModelRemoved(ModelClass &m);
+        void onSyncSourceModelsRemoved(vector<ModelClass*> &models);
         void onModelAttributeChanged(AttrChangeArgs &args);
         void onSyncSourceDestroying(Collection<ModelClass> &syncSourceCollection);
         
@@ -346,6 +888,8 @@ namespace CMS {
         ofEvent < Collection<ModelClass> > collectionDestroyingEvent;
         ofEvent <ModelClass> modelAddedEvent;
         ofEvent <ModelClass> modelRemovedEvent;
+        ofEvent < vector<ModelClass*> > modelsAddedEvent;
+        ofEvent < vector<ModelClass*> > modelsRemovedEvent;
         ofEvent <ModelClass> modelRejectedEvent;
         ofEvent <AttrChangeArgs> modelChangedEvent;
         ofEvent < Collection<ModelClass> > fifoEvent;
@@ -354,6 +898,18 @@ namespace CMS {
 
         vector<ModelClass*> _models;
         Collection<ModelClass>* _syncSource;
+        IdentityMap<ModelClass>* _identityMap;
+        multimap<string, ModelClass*> _idIndex;
+        vector<Index<ModelClass>*> _indexes;
+        map<string, Facet<ModelClass>*> _facets;
+        SearchIndex<ModelClass>* _searchIndex;
+        MemoryBudget<ModelClass>* _memoryBudget;
+        ColumnStore<ModelClass>* _columnStore;
+        // re-used by scans (see ScanFlags)
+        vector<char> _scanFlags;
+        LazySource* _lazySource;
+        ThreadPool* _threadPool;
+        unsigned int mParallelThreshold;
         map<string, string> filterValues;
         map< string, vector<string> > filterVectors;
         map<string, string> rejectValues;
@@ -366,6 +922,26 @@ namespace CMS {
         // destroy models when removing them fmor the collection? (default: false)
         bool bDestroyOnRemove;
 
+        // change tracking (see setChangeTracking)
+        bool bChangeTracking;
+        // true while parsing/applying changes; those changes don't count as local changes
+        bool bIngesting;
+        // true while a Journal replays its records (see parseModelJsonValue)
+        bool bVerbatimStrings;
+        set<ModelClass*> _addedModels;
+        set<ModelClass*> _dirtyModels;
+        set<string> _removedIds;
+
+        // lazy parsing (see setLazyParsing)
+        bool bLazyParsing;
+        vector<string> _eagerAttrs;
+
+        // operation recording (see setTraceRecorder)
+        TraceRecorder* _traceRecorder;
+        string mTraceName;
+
+        template<class> friend class Journal;
+
     }; // class Collection
 
 
@@ -375,21 +951,57 @@ namespace CMS {
     template <class ModelClass>
     CMS::Collection<ModelClass>::~Collection(){
         ofNotifyEvent(collectionDestroyingEvent, *this, this);
+        // going away isn't an operation
+        _traceRecorder = NULL;
 
 		// do this first!
 		stopSyncing();
 
         clear();
         _models.clear(); // just to be sure
+
+        for(typename map<string, Facet<ModelClass>*>::iterator it = _facets.begin(); it != _facets.end(); it++){
+            delete it->second;
+        }
+        _facets.clear();
+        removeSearchIndex();
+        removeMemoryBudget();
+        removeColumns();
+        _indexes.clear();
+
+        if(_lazySource){
+            delete _lazySource;
+            _lazySource = NULL;
+        }
+
+        // whatever we (just) queued can't be delivered anymore
+        EventQueue::destroyed(this);
     }
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::initialize(vector< map<string, string> > &_data){
+        TraceRecorder::Scope trace(_traceRecorder);
+
+        vector<ModelClass*> models;
         for(int i=0; i<_data.size(); i++){
-            // create a cloned copy of each model and add them without triggering modelAdded events
-            add(new ModelClass(&_data[i]), false);
+            // create a cloned copy of each model
+            models.push_back(new ModelClass(&_data[i]));
+            models.back()->commit();
+        }
+
+        if(trace.record()) _traceRecorder->add(mTraceName, vector<Model*>(models.begin(), models.end()), false, true, true);
+
+        // add them without triggering modelsAdded events
+        vector<ModelClass*> rejected;
+        bool ingesting = bIngesting;
+        bIngesting = true;
+        addMany(models, false, &rejected);
+        bIngesting = ingesting;
+        for(int i=0; i<rejected.size(); i++){
+            delete rejected[i];
         }
-        ofNotifyEvent(collectionInitializedEvent, this);
+
+        notifyListeners(collectionInitializedEvent);
     }
 
     template <class ModelClass>
@@ -397,9 +1009,12 @@ namespace CMS {
         // What the hell are we supposed to do with this??
         if(model == NULL) return false;
 
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->add(mTraceName, vector<Model*>(1, model), notify, false);
+
         // apply active filters
         if(!modelPassesActiveFilters(model) || !modelPassesActiveRejections(model)){
-            ofNotifyEvent(modelRejectedEvent, *model, this);
+            notifyListeners(modelRejectedEvent, *model);
             return false;
         }
 
@@ -407,7 +1022,7 @@ namespace CMS {
         if(limitReached()){
             if(bFIFO){
                 ofLog() << "Collection limit ("+ofToString(mLimit)+") reached, removing first model (FIFO)";
-                ofNotifyEvent(fifoEvent, *this, this);
+                notifyListeners(fifoEvent);
                 remove(0);
             } else {
                 ofLog() << "Collection limit ("+ofToString(mLimit)+") reached, can't add model (NO FIFO)";
@@ -417,11 +1032,10 @@ namespace CMS {
 
         // add to our collection
         _models.push_back(model);
-
-        registerModelCallbacks(model);
+        registerModel(model);
 
         // let's tell the world
-        if(notify) ofNotifyEvent(modelAddedEvent, *model, this);
+        if(notify) notifyListeners(modelAddedEvent, *model);
 
         // success!
         return true;
@@ -434,6 +1048,9 @@ namespace CMS {
 			return NULL;
 		}
 
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->remove(mTraceName, vector<Model*>(1, model), doDestroy, false);
+
         for(int i=0; i<this->_models.size(); i++){
             ModelClass* m = _models[i];
             
@@ -460,21 +1077,128 @@ namespace CMS {
 			return NULL;
 		}
 
-        registerModelCallbacks(model, false);
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->remove(mTraceName, vector<Model*>(1, model), doDestroy, false);
+
         _models.erase(_models.begin() + index);
-        ofNotifyEvent(modelRemovedEvent, *model, this);
+        registerModel(model, false, doDestroy && bDestroyOnRemove);
+        notifyListeners(modelRemovedEvent, *model);
 
         if(doDestroy && bDestroyOnRemove){
-            ofLog() << "Destroying removed model (id="+model->id()+", bDestroyOnRemove=true)";
             // destroy(model); // this will try to remove again, which isn't really a problem, just a bit inefficient
-            model->destroy();
-			delete model;
-            return NULL;
+            return destroyRemoved(model) ? NULL : model;
         }
 
         return model;
     }
 
+    template <class ModelClass>
+    unsigned int CMS::Collection<ModelClass>::addMany(const vector<ModelClass*> &models, bool notify, vector<ModelClass*> *rejected){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->add(mTraceName, vector<Model*>(models.begin(), models.end()), notify, true);
+
+        vector<ModelClass*> added;
+        vector<ModelClass*> evicted;
+
+        for(int i=0; i<models.size(); i++){
+            ModelClass* model = models[i];
+            if(model == NULL) continue;
+
+            // apply active filters
+            if(!modelPassesActiveFilters(model) || !modelPassesActiveRejections(model)){
+                notifyListeners(modelRejectedEvent, *model);
+                if(rejected) rejected->push_back(model);
+                continue;
+            }
+
+            // reached our limit, either remove first model, or reject this new model
+            if(limitReached()){
+                if(!bFIFO || _models.empty()){
+                    if(rejected) rejected->push_back(model);
+                    continue;
+                }
+
+                notifyListeners(fifoEvent);
+                ModelClass* first = _models[0];
+                _models.erase(_models.begin());
+                registerModel(first, false);
+
+                // if the first model was added in this same batch, the outside world doesn't know about it yet
+                typename vector<ModelClass*>::iterator it = std::find(added.begin(), added.end(), first);
+                if(it == added.end()){
+                    evicted.push_back(first);
+                } else {
+                    added.erase(it);
+                    if(rejected) rejected->push_back(first);
+                }
+            }
+
+            // add to our collection
+            _models.push_back(model);
+            registerModel(model);
+            added.push_back(model);
+        }
+
+        if(mLimit != NO_LIMIT && added.size() + evicted.size() < models.size()){
+            ofLog() << "Collection limit ("+ofToString(mLimit)+") reached, " << (bFIFO ? ofToString(evicted.size())+" model(s) removed (FIFO)" : "model(s) rejected (NO FIFO)");
+        }
+
+        if(!evicted.empty()){
+            notifyListeners(modelsRemovedEvent, evicted);
+            if(bDestroyOnRemove){
+                for(int i=0; i<evicted.size(); i++)
+                    destroyRemoved(evicted[i]);
+            }
+        }
+
+        // let's tell the world
+        if(notify && !added.empty()) notifyListeners(modelsAddedEvent, added);
+
+        return added.size();
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeMany(const vector<ModelClass*> &models, bool doDestroy){
+        if(models.empty() || _models.empty()) return;
+
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->remove(mTraceName, vector<Model*>(models.begin(), models.end()), doDestroy, true);
+
+        bool destroying = doDestroy && bDestroyOnRemove;
+        vector<ModelClass*> removed = removeModels(models, destroying);
+
+        if(destroying){
+            for(int i=0; i<removed.size(); i++)
+                destroyRemoved(removed[i]);
+        }
+    }
+
+    template <class ModelClass>
+    vector<ModelClass*> CMS::Collection<ModelClass>::removeModels(const vector<ModelClass*> &models, bool destroying){
+        set<ModelClass*> toRemove(models.begin(), models.end());
+        vector<ModelClass*> removed;
+
+        // single pass over our models, keeping the order of the remaining models
+        int count = 0;
+        for(int i=0; i<_models.size(); i++){
+            ModelClass* model = _models[i];
+
+            if(toRemove.find(model) == toRemove.end()){
+                _models[count++] = model;
+                continue;
+            }
+
+            registerModel(model, false, destroying);
+            removed.push_back(model);
+        }
+
+        if(removed.empty()) return removed;
+        _models.resize(count);
+
+        notifyListeners(modelsRemovedEvent, removed);
+        return removed;
+    }
+
     template <class ModelClass>
     void CMS::Collection<ModelClass>::destroy(ModelClass *model){
         if(model == NULL){
@@ -482,16 +1206,26 @@ namespace CMS {
 			return;
 		}
 
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->destroy(mTraceName, model);
+
         remove(model, false /* just remove, no destroy */);
+        // still in use by another collection sharing our identity map? Leave it alone
+        if(isShared(model)) return;
         model->destroy();
 		delete model;
     }
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::destroy(int idx){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record() && at(idx)) _traceRecorder->destroy(mTraceName, at(idx));
+
         ModelClass* m = remove(idx, false /* just remove no destroy */);
 
 		if(m){
+            // still in use by another collection sharing our identity map? Leave it alone
+            if(isShared(m)) return;
 			m->destroy();
 			delete m;
 			return;
@@ -502,6 +1236,9 @@ namespace CMS {
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::destroyAll(){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->destroyAll(mTraceName);
+
         for(int i=_models.size()-1; i>=0; i--){
             destroy(i);
         }
@@ -509,11 +1246,217 @@ namespace CMS {
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::clear(){
-        for(int i=_models.size()-1; i>=0; i--){
-            remove(_models[i]);
-        }
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->clear(mTraceName);
+
+        // copy; removeMany modifies _models
+        vector<ModelClass*> models = _models;
+        removeMany(models);
     }
    
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::setIdentityMap(IdentityMap<ModelClass> *identityMap){
+        if(identityMap == _identityMap) return;
+
+        // move our references from the current identity map (if any) to the new one (if any)
+        for(int i=0; i<_models.size(); i++){
+            if(_identityMap) _identityMap->release(_models[i]);
+            if(identityMap) identityMap->retain(_models[i]);
+        }
+
+        _identityMap = identityMap;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::addIndex(Index<ModelClass> *index){
+        if(index == NULL || std::find(_indexes.begin(), _indexes.end(), index) != _indexes.end()) return;
+
+        // bring the index up-to-date with our current content
+        for(int i=0; i<_models.size(); i++){
+            index->indexModel(_models[i]);
+        }
+
+        _indexes.push_back(index);
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeIndex(Index<ModelClass> *index){
+        typename vector<Index<ModelClass>*>::iterator it = std::find(_indexes.begin(), _indexes.end(), index);
+        if(it != _indexes.end()) _indexes.erase(it);
+    }
+
+    template <class ModelClass>
+    Facet<ModelClass> &CMS::Collection<ModelClass>::facet(const string &attr, bool trackModels){
+        typename map<string, Facet<ModelClass>*>::iterator it = _facets.find(attr);
+
+        if(it != _facets.end()){
+            // keep the instance; callers might hold on to it
+            if(trackModels) it->second->trackModels(_models);
+            return *it->second;
+        }
+
+        Facet<ModelClass> *facet = new Facet<ModelClass>(attr, trackModels);
+        addIndex(facet);
+        _facets[attr] = facet;
+        return *facet;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeFacet(const string &attr){
+        typename map<string, Facet<ModelClass>*>::iterator it = _facets.find(attr);
+        if(it == _facets.end()) return;
+
+        removeIndex(it->second);
+        delete it->second;
+        _facets.erase(it);
+    }
+
+    template <class ModelClass>
+    SearchIndex<ModelClass> &CMS::Collection<ModelClass>::searchIndex(const vector<string> &attrs){
+        if(_searchIndex){
+            if(_searchIndex->attrs() == attrs) return *_searchIndex;
+            removeSearchIndex();
+        }
+
+        _searchIndex = new SearchIndex<ModelClass>(attrs);
+        addIndex(_searchIndex);
+        return *_searchIndex;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeSearchIndex(){
+        if(_searchIndex == NULL) return;
+        removeIndex(_searchIndex);
+        delete _searchIndex;
+        _searchIndex = NULL;
+    }
+
+    template <class ModelClass>
+    MemoryBudget<ModelClass> &CMS::Collection<ModelClass>::setMemoryBudget(size_t bytes, const string &spillPath){
+        if(_memoryBudget){
+            _memoryBudget->setBudget(bytes);
+            return *_memoryBudget;
+        }
+
+        // the budget can't manage models that are still waiting to be decoded (see setLazyParsing)
+        if(_lazySource){
+            for(int i=0; i<_models.size(); i++) _lazySource->materialize(_models[i]);
+        }
+
+        _memoryBudget = new MemoryBudget<ModelClass>(bytes, spillPath);
+        addIndex(_memoryBudget);
+        return *_memoryBudget;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeMemoryBudget(){
+        if(_memoryBudget == NULL) return;
+
+        // this loads back all spilled attributes
+        for(int i=0; i<_models.size(); i++){
+            _memoryBudget->unindexModel(_models[i]);
+        }
+
+        removeIndex(_memoryBudget);
+        delete _memoryBudget;
+        _memoryBudget = NULL;
+    }
+
+    template <class ModelClass>
+    ColumnStore<ModelClass> &CMS::Collection<ModelClass>::columns(const vector<string> &attrs){
+        if(_columnStore){
+            if(_columnStore->attrs() == attrs) return *_columnStore;
+            removeColumns();
+        }
+
+        _columnStore = new ColumnStore<ModelClass>(attrs);
+        addIndex(_columnStore);
+        return *_columnStore;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::removeColumns(){
+        if(_columnStore == NULL) return;
+        removeIndex(_columnStore);
+        delete _columnStore;
+        _columnStore = NULL;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::setChangeTracking(bool enable){
+        if(enable == bChangeTracking) return;
+
+        bChangeTracking = enable;
+        _addedModels.clear();
+        _dirtyModels.clear();
+        _removedIds.clear();
+
+        if(!enable) return;
+
+        // pick up models that were already changed
+        for(int i=0; i<_models.size(); i++){
+            _models[i]->setDirtyTracking(true);
+            if(_models[i]->isDirty()) _dirtyModels.insert(_models[i]);
+        }
+    }
+
+    template <class ModelClass>
+    ChangeSet CMS::Collection<ModelClass>::changes(){
+        ChangeSet changeSet;
+
+        for(typename set<ModelClass*>::iterator it = _addedModels.begin(); it != _addedModels.end(); it++){
+            changeSet.added[(*it)->id()] = (*it)->attributes();
+        }
+
+        for(typename set<ModelClass*>::iterator it = _dirtyModels.begin(); it != _dirtyModels.end(); it++){
+            changeSet.updated[(*it)->id()] = (*it)->changedAttributes();
+        }
+
+        changeSet.removed.assign(_removedIds.begin(), _removedIds.end());
+        return changeSet;
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::commit(){
+        for(typename set<ModelClass*>::iterator it = _addedModels.begin(); it != _addedModels.end(); it++){
+            (*it)->commit();
+        }
+
+        for(typename set<ModelClass*>::iterator it = _dirtyModels.begin(); it != _dirtyModels.end(); it++){
+            (*it)->commit();
+        }
+
+        _addedModels.clear();
+        _dirtyModels.clear();
+        _removedIds.clear();
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::setTraceRecorder(TraceRecorder *recorder, const string &name){
+        _traceRecorder = recorder;
+        mTraceName = name;
+        if(_traceRecorder == NULL || !_traceRecorder->isRecording()) return;
+
+        // the replay starts from what we've got right now
+        _traceRecorder->collection(mTraceName, bFIFO, bDestroyOnRemove, bLazyParsing, mLimit, _eagerAttrs);
+
+        for(map<string, string>::iterator it = filterValues.begin(); it != filterValues.end(); it++)
+            _traceRecorder->filterBy(mTraceName, it->first, vector<string>(1, it->second), true, false);
+        for(map< string, vector<string> >::iterator it = filterVectors.begin(); it != filterVectors.end(); it++)
+            _traceRecorder->filterBy(mTraceName, it->first, it->second, true, false);
+        for(map<string, string>::iterator it = rejectValues.begin(); it != rejectValues.end(); it++)
+            _traceRecorder->filterBy(mTraceName, it->first, vector<string>(1, it->second), true, true);
+        for(map< string, vector<string> >::iterator it = rejectVectors.begin(); it != rejectVectors.end(); it++)
+            _traceRecorder->filterBy(mTraceName, it->first, it->second, true, true);
+
+        // a sync source that's being recorded as well provides our models
+        if(_syncSource && _syncSource->getTraceRecorder() == _traceRecorder){
+            _traceRecorder->syncsFrom(mTraceName, _syncSource->getTraceName(), true);
+        } else if(!_models.empty()){
+            _traceRecorder->add(mTraceName, vector<Model*>(_models.begin(), _models.end()), false, true);
+        }
+    }
+
     template <class ModelClass>
     const vector<ModelClass*> &CMS::Collection<ModelClass>::models(){
         return _models;
@@ -545,22 +1488,31 @@ namespace CMS {
 
     template <class ModelClass>
     ModelClass* CMS::Collection<ModelClass>::findByAttr(const string &attr, const string &value){
-        for(int i=0; i<_models.size(); i++){
-            if(_models[i]->get(attr) == value)
-                return _models[i];
+        // small collections; just stop at the first match
+        if((_threadPool == NULL || _models.size() < mParallelThreshold) && (_columnStore == NULL || !_columnStore->hasColumn(attr))){
+            for(int i=0; i<_models.size(); i++){
+                if(_models[i]->attrEquals(attr, value))
+                    return _models[i];
+            }
+
+            return NULL;
         }
-        
+
+        ScanFlags flags(_scanFlags);
+        if(!scanColumn(attr, value, flags))
+            scan([&](ModelClass* model){ return model->attrEquals(attr, value); }, flags);
+
+        for(int i=0; i<flags.size(); i++){
+            if(flags[i]) return _models[i];
+        }
+
         return NULL;
     }
 
     template <class ModelClass>
     ModelClass* CMS::Collection<ModelClass>::findById(const string &_id){
-        for(int i=0; i<_models.size(); i++){
-            if(_models[i]->id() == _id)
-                return _models[i];
-        }
-        
-        return NULL;
+        typename multimap<string, ModelClass*>::iterator it = _idIndex.find(_id);
+        return it == _idIndex.end() ? NULL : it->second;
     }
 
     template <class ModelClass>
@@ -571,44 +1523,73 @@ namespace CMS {
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::filterBy(const string &key, const string &val){
-        // we have to do this backwards! because every time you remove a model,
-        // it messes with all the following index values
-        for(int i=_models.size()-1; i>=0; i--){
-            // get current model
-            ModelClass* model = at(i);
-            // remove it, if it doesn't meet the criteria
-            if(!modelPassesSingleValueFilter(model, key, val)) remove(model);
-        }
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->filterBy(mTraceName, key, vector<string>(1, val), false, false);
+
+        ScanFlags flags(_scanFlags);
+        if(!scanColumn(key, val, flags, true))
+            scan([&](ModelClass* model){ return !modelPassesSingleValueFilter(model, key, val); }, flags);
+        // remove all models that don't meet the criteria
+        removeFlagged(flags);
     }
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::filterBy(const string &key, vector<string> &values){
-        // we have to do this backwards! because every time you remove a model,
-        // it messes with all the following index values
-        for(int i=_models.size()-1; i>=0; i--){
-            // get current model
-            ModelClass* model = at(i);
-            // remove it, if it doesn't meet the criteria
-            if(!modelPassesMultiValueFilter(model, key, values)) remove(model);
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->filterBy(mTraceName, key, values, false, false);
+
+        ScanFlags flags(_scanFlags);
+        if(!scanColumn(key, values, flags, true))
+            scan([&](ModelClass* model){ return !modelPassesMultiValueFilter(model, key, values); }, flags);
+        // remove all models that don't meet the criteria
+        removeFlagged(flags);
+    }
+
+    template <class ModelClass>
+    void CMS::Collection<ModelClass>::filterByRange(const string &key, double min, double max){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->filterByRange(mTraceName, key, min, max);
+
+        ScanFlags flags(_scanFlags);
+
+        if(_columnStore && _columnStore->hasColumn(key)){
+            _columnStore->align(_models);
+            _columnStore->matchRange(key, min, max, flags, true);
+        } else {
+            scan([&](ModelClass* model){
+                const string *value = model->lookup(key);
+                double number = value ? ColumnStore<ModelClass>::toNumber(*value) : NAN;
+                return !(number >= min && number <= max);
+            }, flags);
         }
+
+        // remove all models that don't meet the criteria
+        removeFlagged(flags);
     }
 
     template <class ModelClass>
     void CMS::Collection<ModelClass>::destroyBy(const string &key, const string &value){
-        // we have to do this backwards! because every time you remove a model,
-        // it messes with all the following index values
-        for(int i=_models.size()-1; i>=0; i--){
-            // get current model
-            ModelClass* model = at(i);
-            // remove it, if it doesn't meet the criteria
-            if(model->get(key) == value) destroy(model);
-        }
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->destroyBy(mTraceName, key, value);
+
+        ScanFlags flags(_scanFlags);
+        if(!scanColumn(key, value, flags))
+            scan([&](ModelClass* model){ return model->attrEquals(key, value); }, flags);
+        // destroy all models that meet the criteria
+        removeFlagged(flags, true);
     }
 
     template <class ModelClass>
-    bool Collection<ModelClass>::parse(const string &jsonText, bool doRemove, bool doUpdate, bool doCreate){
+    bool Collection<ModelClass>::parse(const string &jsonText, bool doRemove, bool doUpdate, bool doCreate, ParseDiff *diff){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->parse(mTraceName, jsonText, doRemove, doUpdate, doCreate);
+
+        if(bLazyParsing && !_memoryBudget) return parseLazy(jsonText, doRemove, doUpdate, doCreate, diff);
+
         ofxJSONElement json;
 
+        if(diff) diff->clear();
+
         // try to parse json, abort if it fails
         if(!json.parse(jsonText)){
             ofLogWarning() << "Couldn't parse JSON:\n--JSON START --\n" << jsonText << "\n--JSON END --";
@@ -621,73 +1602,301 @@ namespace CMS {
             return false;
         }
 
+        // parsed changes are not local changes (see setChangeTracking)
+        bool ingesting = bIngesting;
+        bIngesting = true;
+
         if(doRemove){
+            // collect all ids in the new json once, instead of looping over the json for every model
+            set<string> jsonIds;
+            for(int j=0; j<json.size(); j++){
+                if(!json[j]["_id"]["$oid"].isNull())
+                    jsonIds.insert(json[j]["_id"]["$oid"].asString());
+            }
+
             // loop over all models that were already in the collection,
             // remove any model for which we can't find any record in the new json
-            // IMPORTANT! Gotta start with the highest indexes first, because otherwise indexes
-            // of higher-up models get messed up when removing models earlier in the list
-            for(int i=_models.size()-1; i>=0; i--){
-                // assume we'll have to remove the model as long as we haven't found a matching record in the json
-                bool remove_model = true;
-                
+            vector<ModelClass*> removed;
+            for(int i=0; i<_models.size(); i++){
                 // get the current model's id to match on
-                string id = _models[i]->id();
-                
-                // loop over all items in the new json to see if there's a record with the same id
-                for(int j=0; j<json.size(); j++){
-                    // if there's a record with this id, we don't have to do anything
-                    if(json[j]["_id"]["$oid"] == id)
-                        remove_model = false;
-                }
-                
-                // if remove_model us still true, this means that no records with a matching id was found,
-                // meaning this in-memory record in no-longer was removed from the collection and we should drop it as well
-                if(remove_model){
-                    destroy(_models[i]);
+                const string &id = _models[i]->id();
+
+                // if no records with a matching id was found, this in-memory record
+                // was removed from the collection and we should drop it as well
+                if(jsonIds.find(id) == jsonIds.end()){
+                    if(diff) diff->removed.push_back(id);
+                    removed.push_back(_models[i]);
                 }
             }
+
+            // remove them in one batch, then destroy them (unless they're still in use
+            // by another collection sharing our identity map)
+            removeModels(removed, true);
+            for(int i=0; i<removed.size(); i++)
+                destroyRemoved(removed[i], false);
         }
 
+        // new models are collected and added in a single batch at the end
+        vector<ModelClass*> newModels;
+        // new models by id; in case the json has multiple records with the same id
+        map<string, ModelClass*> created;
+
         for(int i = 0; i < json.size(); i++) {
-            ModelClass *existing = json[i]["_id"]["$oid"].isNull() ? NULL : findById(json[i]["_id"]["$oid"].asString());
+            Json::Value &idValue = json[i]["_id"]["$oid"];
+            string id = idValue.isNull() ? "" : idValue.asString();
+            ModelClass *existing = idValue.isNull() ? NULL : findById(id);
+
+            if(existing == NULL && !idValue.isNull() && created.find(id) != created.end()){
+                // let the update logic (below) deal with this record
+                existing = created[id];
+            }
 
             // found existing model with same id? update it by setting its json attribute
             if(existing && doUpdate){
+                // skip records that didn't change since the last time we parsed them
+                unsigned long long fingerprint = jsonFingerprint(json[i]);
+                if(existing->matchesFingerprint(fingerprint)){
+                    if(diff) diff->unchanged.push_back(id);
+                    continue;
+                }
+
                 // let the Model attribute changed callbacks deal with further parsing
-                parseModelJson(existing, ((ofxJSONElement)json[i]).getRawString(false));
+                parseModelJson(existing, json[i]);
+                existing->setFingerprint(fingerprint);
+                if(diff) diff->updated.push_back(existing->id());
 
             } else if(doCreate){
                 // do an early limit check, to avoid unnecessary parsing
-                if(limitReached() && !bFIFO){
+                if(mLimit != NO_LIMIT && _models.size() + newModels.size() >= mLimit && !bFIFO){
                     ofLog() << "Collection parsing: model skipped because limit reached (NO FIFO)";
                 } else {
-                    //  not existing model found? Add a new one
-                    ModelClass *new_model = new ModelClass();
-
-                    parseModelJson(new_model, ((ofxJSONElement)json[i]).getRawString(false));
-                    // if we couldn't add this model to the collection
-                    // destroy the model, otherwise it's just hanging out in memory
-                    if(!add(new_model)){
-                        delete new_model;
+                    //  not existing model found? Re-use the instance of another collection
+                    // that shares our identity map, or add a new one
+                    ModelClass *new_model = idValue.isNull() ? NULL : findShared(id);
+                    if(new_model == NULL) new_model = new ModelClass();
+
+                    unsigned long long fingerprint = jsonFingerprint(json[i]);
+                    // shared models might have already been parsed from the same record
+                    if(!new_model->matchesFingerprint(fingerprint)){
+                        parseModelJson(new_model, json[i]);
+                        new_model->setFingerprint(fingerprint);
                     }
+
+                    newModels.push_back(new_model);
+                    if(!idValue.isNull()) created[id] = new_model;
                 }
             }
         }
 
+        vector<ModelClass*> rejected;
+        addMany(newModels, true, &rejected);
+
+        // if we couldn't add a model to the collection
+        // destroy the model, otherwise it's just hanging out in memory
+        // (unless it's shared; then it's not ours to destroy)
+        set<ModelClass*> rejectedSet(rejected.begin(), rejected.end());
+        for(int i=0; i<newModels.size(); i++){
+            if(rejectedSet.find(newModels[i]) == rejectedSet.end()){
+                if(diff) diff->added.push_back(newModels[i]->id());
+            } else if(!isShared(newModels[i])){
+                delete newModels[i];
+            }
+        }
+
+        bIngesting = ingesting;
         ofLogVerbose() << "CMS::Collection::parse() finished, number of models in collection: " << _models.size();
-        ofNotifyEvent(collectionInitializedEvent, this);
+        notifyListeners(collectionInitializedEvent);
+        return true;
+    }
+
+    // the lazy version of parse(); same logic, but on the records' byte ranges instead of decoded json
+    template <class ModelClass>
+    bool Collection<ModelClass>::parseLazy(const string &jsonText, bool doRemove, bool doUpdate, bool doCreate, ParseDiff *diff){
+        if(diff) diff->clear();
+
+        // the models keep a reference to this buffer until they're decoded
+        std::shared_ptr<const string> buffer(new string(jsonText));
+        const string &text = *buffer;
+        vector<LazySource::Slice> records;
+
+        // make sure we've got an array, we're a collection after all
+        if(!LazySource::splitArray(text, records)){
+            ofLogWarning() << "JSON not an array:\n--JSON START --\n" << jsonText << "\n--JSON END --";
+            return false;
+        }
+
+        if(_lazySource == NULL) _lazySource = new LazySource([this](Json::Value &value){ return parseModelJsonValue(value); });
+        std::shared_ptr<const set<string> > eagerAttrs = eagerAttributes();
+
+        // parsed changes are not local changes (see setChangeTracking)
+        bool ingesting = bIngesting;
+        bIngesting = true;
+
+        // the id and eager attributes of every record
+        vector< vector<LazySource::Member> > eagerMembers(records.size());
+        vector<string> ids(records.size());
+        vector<char> hasId(records.size(), 0);
+        vector<char> valid(records.size(), 1);
+
+        for(int i=0; i<records.size(); i++){
+            vector<LazySource::Member> members;
+            if(!LazySource::splitObject(text, records[i], members)){
+                ofLogWarning() << "CMS::Collection::parse() - skipping invalid record: " << text.substr(records[i].begin, records[i].size());
+                valid[i] = 0;
+                continue;
+            }
+
+            for(int m=0; m<members.size(); m++){
+                if(eagerAttrs->find(members[m].key) == eagerAttrs->end()) continue;
+                eagerMembers[i].push_back(members[m]);
+
+                // mongoDB-style id; {"_id": {"$oid": "..."}}
+                if(members[m].key == "_id" && text[members[m].value.begin] == '{'){
+                    Json::Reader reader;
+                    Json::Value idValue;
+                    if(reader.parse(text.data() + members[m].value.begin, text.data() + members[m].value.end, idValue, false) && !idValue["$oid"].isNull()){
+                        ids[i] = idValue["$oid"].asString();
+                        hasId[i] = 1;
+                    }
+                }
+            }
+        }
+
+        if(doRemove){
+            // collect all ids in the new json once, instead of looping over the json for every model
+            set<string> jsonIds;
+            for(int i=0; i<records.size(); i++){
+                if(hasId[i]) jsonIds.insert(ids[i]);
+            }
+
+            // remove any model for which we can't find any record in the new json
+            vector<ModelClass*> removed;
+            for(int i=0; i<_models.size(); i++){
+                const string &id = _models[i]->id();
+
+                if(jsonIds.find(id) == jsonIds.end()){
+                    if(diff) diff->removed.push_back(id);
+                    removed.push_back(_models[i]);
+                }
+            }
+
+            // remove them in one batch, then destroy them (unless they're still in use
+            // by another collection sharing our identity map)
+            removeModels(removed, true);
+            for(int i=0; i<removed.size(); i++)
+                destroyRemoved(removed[i], false);
+        }
+
+        // new models are collected and added in a single batch at the end
+        vector<ModelClass*> newModels;
+        // new models by id; in case the json has multiple records with the same id
+        map<string, ModelClass*> created;
+
+        for(int i=0; i<records.size(); i++){
+            if(!valid[i]) continue;
+
+            ModelClass *existing = hasId[i] ? findById(ids[i]) : NULL;
+            if(existing == NULL && hasId[i] && created.find(ids[i]) != created.end()){
+                // let the update logic (below) deal with this record
+                existing = created[ids[i]];
+            }
+
+            // the records' bytes are their fingerprint
+            unsigned long long fingerprint = Model::fingerprint(text.data() + records[i].begin, records[i].size());
+
+            if(existing && doUpdate){
+                // skip records that didn't change since the last time we parsed them
+                if(existing->matchesFingerprint(fingerprint)){
+                    if(diff) diff->unchanged.push_back(ids[i]);
+                    continue;
+                }
+
+                // updates are decoded right away
+                parseModelJson(existing, text, records[i]);
+                existing->setFingerprint(fingerprint);
+                if(diff) diff->updated.push_back(existing->id());
+
+            } else if(doCreate){
+                // do an early limit check, to avoid unnecessary parsing
+                if(mLimit != NO_LIMIT && _models.size() + newModels.size() >= mLimit && !bFIFO){
+                    ofLog() << "Collection parsing: model skipped because limit reached (NO FIFO)";
+                    continue;
+                }
+
+                // re-use the instance of another collection that shares our identity map
+                ModelClass *new_model = hasId[i] ? findShared(ids[i]) : NULL;
+
+                if(new_model){
+                    // shared models might have already been parsed from the same record
+                    if(!new_model->matchesFingerprint(fingerprint)){
+                        parseModelJson(new_model, text, records[i]);
+                        new_model->setFingerprint(fingerprint);
+                    }
+                } else {
+                    new_model = new ModelClass();
+
+                    // just the eager attributes; the rest is decoded on first access
+                    bool tracking = new_model->getDirtyTracking();
+                    new_model->setDirtyTracking(false);
+                    for(int m=0; m<eagerMembers[i].size(); m++){
+                        new_model->set(eagerMembers[i][m].key, _lazySource->decode(text, eagerMembers[i][m].value));
+                    }
+                    new_model->setDirtyTracking(tracking);
+
+                    _lazySource->attach(new_model, buffer, records[i], eagerAttrs);
+                    new_model->setFingerprint(fingerprint);
+                }
+
+                newModels.push_back(new_model);
+                if(hasId[i]) created[ids[i]] = new_model;
+            }
+        }
+
+        vector<ModelClass*> rejected;
+        addMany(newModels, true, &rejected);
+
+        // if we couldn't add a model to the collection
+        // destroy the model, otherwise it's just hanging out in memory
+        // (unless it's shared; then it's not ours to destroy)
+        set<ModelClass*> rejectedSet(rejected.begin(), rejected.end());
+        for(int i=0; i<newModels.size(); i++){
+            if(rejectedSet.find(newModels[i]) == rejectedSet.end()){
+                if(diff) diff->added.push_back(newModels[i]->id());
+            } else if(!isShared(newModels[i])){
+                _lazySource->release(newModels[i]);
+                delete newModels[i];
+            }
+        }
+
+        bIngesting = ingesting;
+        ofLogVerbose() << "CMS::Collection::parse() finished (lazy), number of models in collection: " << _models.size();
+        notifyListeners(collectionInitializedEvent);
+        return true;
+    }
+
+    template <class ModelClass>
+    bool Collection<ModelClass>::parseModelJson(ModelClass *model, const string &text, const LazySource::Slice &record){
+        Json::Reader reader;
+        Json::Value json;
+
+        if(!reader.parse(text.data() + record.begin, text.data() + record.end, json, false) || !json.isObject()){
+            ofLogWarning() << "CMS::Collection::parseModelJson() - couldn't parse json:\n-- JSON start --\n" << text.substr(record.begin, record.size()) << "\n-- JSON end --";
+            return false;
+        }
+
+        parseModelJson(model, json);
         return true;
     }
 
     // for convenience
     template <class ModelClass>
-    bool Collection<ModelClass>::parse(const ofxJSONElement & node, bool doRemove, bool doUpdate, bool doCreate){
+    bool Collection<ModelClass>::parse(const ofxJSONElement & node, bool doRemove, bool doUpdate, bool doCreate, ParseDiff *diff){
         if(node.type() == Json::nullValue) return false;
         
         // Can't figure out how to use this kinda object, so for now; let the text-based parse method deal with it
         // (meaning we'll convert back to text, and parse that to json again... yea...)
-        if(node.type() == Json::stringValue) return parse(node.asString(), doRemove, doUpdate, doCreate);
-        return parse(node.getRawString(), doRemove, doUpdate, doCreate);
+        if(node.type() == Json::stringValue) return parse(node.asString(), doRemove, doUpdate, doCreate, diff);
+        return parse(node.getRawString(), doRemove, doUpdate, doCreate, diff);
     }
 
     template <class ModelClass>
@@ -699,10 +1908,168 @@ namespace CMS {
             return;
         }
 
-        vector<string> attrs = doc.getMemberNames();
+        parseModelJson(model, doc);
+    }
+
+    template <class ModelClass>
+    void Collection<ModelClass>::parseModelJson(ModelClass *model, Json::Value &node){
+        // parsed attributes are in sync with their source; they're not dirty
+        bool tracking = model->getDirtyTracking();
+        model->setDirtyTracking(false);
+
+        vector<string> attrs = node.getMemberNames();
         for(int i=0; i<attrs.size(); i++){
-            model->set(attrs[i], parseModelJsonValue(doc[attrs[i]]));
+            model->set(attrs[i], parseModelJsonValue(node[attrs[i]]));
+        }
+
+        model->setDirtyTracking(tracking);
+    }
+
+    // hashes a json value's content (type + data) without serializing it
+    template <class ModelClass>
+    unsigned long long Collection<ModelClass>::jsonFingerprint(const Json::Value &value, unsigned long long seed){
+        char type = (char)value.type();
+        unsigned long long hash = Model::fingerprint(&type, 1, seed);
+
+        if(value.isObject()){
+            vector<string> members = value.getMemberNames();
+            for(int i=0; i<members.size(); i++){
+                hash = Model::fingerprint(members[i].c_str(), members[i].size()+1 /* include terminator as separator */, hash);
+                hash = jsonFingerprint(value[members[i]], hash);
+            }
+            return hash;
+        }
+
+        if(value.isArray()){
+            for(int i=0; i<value.size(); i++)
+                hash = jsonFingerprint(value[i], hash);
+            return hash;
+        }
+
+        if(value.isString()){
+            const char *str = value.asCString();
+            return Model::fingerprint(str, strlen(str)+1, hash);
+        }
+
+        if(value.isBool()){
+            char b = value.asBool() ? 1 : 0;
+            return Model::fingerprint(&b, 1, hash);
+        }
+
+        // numbers as the json writer would write them; doubles would lose the precision of large integers
+        if(value.isNumeric()){
+            string number;
+            if(value.type() == Json::intValue)
+                number = Json::valueToString(value.asLargestInt());
+            else if(value.type() == Json::uintValue)
+                number = Json::valueToString(value.asLargestUInt());
+            else
+                number = Json::valueToString(value.asDouble());
+            return Model::fingerprint(number.c_str(), number.size(), hash);
+        }
+
+        // null
+        return hash;
+    }
+
+    template <class ModelClass>
+    ChangeFeedResult Collection<ModelClass>::applyChanges(const string &jsonLines, size_t offset){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->applyChanges(mTraceName, offset < jsonLines.size() ? jsonLines.substr(offset) : string());
+
+        ChangeFeedResult result;
+        result.offset = offset;
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+
+        // applied changes are not local changes (see setChangeTracking)
+        bool ingesting = bIngesting;
+        bIngesting = true;
+
+        while(result.offset < jsonLines.size()){
+            size_t lineEnd = jsonLines.find('\n', result.offset);
+            bool terminated = lineEnd != string::npos;
+            if(!terminated) lineEnd = jsonLines.size();
+
+            string line = jsonLines.substr(result.offset, lineEnd - result.offset);
+            ofxJSONElement record;
+
+            if(!record.parse(line)){
+                // an unterminated last line is probably still being written; leave it for the next call
+                if(!terminated) break;
+
+                // skip empty lines silently
+                if(line.find_first_not_of(" \r\t") != string::npos){
+                    ofLogWarning() << "CMS::Collection::applyChanges() - couldn't parse change record: " << line;
+                    result.skipped++;
+                }
+            } else if(!record.isObject() || !record.isMember("op") || !record.isMember("id")){
+                ofLogWarning() << "CMS::Collection::applyChanges() - invalid change record: " << line;
+                result.skipped++;
+            } else if(!applyChange(record)){
+                result.skipped++;
+            } else if(record["op"].asString() == "delete"){
+                result.deleted++;
+            } else {
+                result.upserted++;
+            }
+
+            result.offset = terminated ? lineEnd + 1 : lineEnd;
+        }
+
+        bIngesting = ingesting;
+
+        float seconds = (ofGetElapsedTimeMicros() - startTime) / 1000000.0f;
+        unsigned int count = result.upserted + result.deleted + result.skipped;
+        result.recordsPerSecond = seconds > 0.0f ? count / seconds : 0.0f;
+
+        ofLogVerbose() << "CMS::Collection::applyChanges() finished, " << count << " records (" << result.recordsPerSecond << "/s), number of models in collection: " << _models.size();
+        return result;
+    }
+
+    template <class ModelClass>
+    bool Collection<ModelClass>::applyChange(Json::Value &record){
+        string op = record["op"].asString();
+        string id = parseModelJsonValue(record["id"]);
+        ModelClass *existing = findById(id);
+
+        if(op == "delete"){
+            if(existing == NULL) return false;
+            destroy(existing);
+            return true;
+        }
+
+        if(op != "upsert"){
+            ofLogWarning() << "CMS::Collection::applyChange() - unknown op: " << op;
+            return false;
+        }
+
+        Json::Value &attrs = record["attrs"];
+
+        if(existing){
+            if(attrs.isObject()) parseModelJson(existing, attrs);
+            return true;
+        }
+
+        // do an early limit check, to avoid unnecessary parsing
+        if(limitReached() && !bFIFO) return false;
+
+        // re-use the instance of another collection that shares our identity map, or create a new one
+        ModelClass *new_model = findShared(id);
+        if(new_model == NULL){
+            new_model = new ModelClass();
+            // make sure the new model gets the record's id, even if the attrs don't mention it
+            if(!attrs.isObject() || (!attrs.isMember("id") && !attrs.isMember("_id"))){
+                new_model->set("_id", id);
+                new_model->commit();
+            }
         }
+
+        if(attrs.isObject()) parseModelJson(new_model, attrs);
+
+        if(add(new_model)) return true;
+
+        if(!isShared(new_model)) delete new_model;
+        return false;
     }
 
     template <class ModelClass>
@@ -711,6 +2078,8 @@ namespace CMS {
         if(value.isObject() && value.isMember("$oid")) return value["$oid"].asString();
         if(value.isObject() && value.isMember("$date")) return ofToString(value["$date"]);
         if(value.isObject()) return ((ofxJSONElement)value).getRawString(false);
+        // records written by a Journal hold the exact attribute values
+        if(bVerbatimStrings && value.isString()) return value.asString();
         // here's a real clumsy way of removing leading and trailing white-space and double-quotes;
         string val = ofToString(value);
         // trim left
@@ -744,14 +2113,18 @@ namespace CMS {
 
     template <class ModelClass>
     void Collection<ModelClass>::clone(Collection<ModelClass> &source){
-        clear(); // triggers modelRemovedEvents for each model
-        for(int i=0; i<source.models().size(); i++){
-            add(source.at(i)); // trigges modelAddedEvents
-        }
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->clone(mTraceName, source.getTraceName());
+
+        clear(); // triggers a single modelsRemovedEvent
+        addMany(source.models()); // triggers a single modelsAddedEvent
     }
 
     template <class ModelClass>
     void Collection<ModelClass>::syncsFrom(Collection<ModelClass> &collection, bool clearFirst){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->syncsFrom(mTraceName, collection.getTraceName(), clearFirst);
+
         // first, UNregister existing sync source callbacks
         stopSyncing();
         // we'll need this at destructor-time to unregister event callbacks
@@ -766,6 +2139,9 @@ namespace CMS {
 
     template <class ModelClass>
     void Collection<ModelClass>::stopSyncing(){
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record() && _syncSource) _traceRecorder->stopSyncing(mTraceName);
+
         if(_syncSource){
             registerSyncCallbacks(*_syncSource, false);
             _syncSource = NULL;
@@ -776,11 +2152,17 @@ namespace CMS {
     // inherit from Model which has an ofEvent<Model> beforeDestroyEvent attribute which they all use...
     template <class ModelClass>
     void Collection<ModelClass>::onModelDestroying(Model& model){
+        // destroyed by the application (not by one of our own calls)
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->modelDestroy(mTraceName, &model);
+
         remove((ModelClass*)&model, false /* just remove */);
     }
 
     template <class ModelClass>
     void Collection<ModelClass>::onSyncSourceModelRemoved(ModelClass &model){
+        // syncing isn't recorded; it happens again when replaying the source's operations
+        TraceRecorder::Scope trace(_traceRecorder);
         // we could just do `remove(&model);` here, but even though that model checks if the model exists in this collection,
         // it kinda assumes it does and logs a warning message when this is not the case. Since it's very likely that a model
         // that we receive in this callback function is NOT part of our collection, we perform this check here.
@@ -792,9 +2174,31 @@ namespace CMS {
     // inherit from Model which has an ofEvent<Model> beforeDestroyEvent attribute which they all use...
     template <class ModelClass>
     void Collection<ModelClass>::onModelAttributeChanged(AttrChangeArgs &args){
+        // changed by the application (not while parsing, for example)
+        TraceRecorder::Scope trace(_traceRecorder);
+        if(trace.record()) _traceRecorder->set(mTraceName, args.model, args.attr, args.value);
+
+        // keep our id index up-to-date
+        if(args.attr == "id" || args.attr == "_id"){
+            unindexId((ModelClass*)args.model);
+            indexId((ModelClass*)args.model);
+        }
+
+        for(int i=0; i<_indexes.size(); i++){
+            _indexes[i]->updateModel((ModelClass*)args.model, args.attr, args.value, args.old_value);
+        }
+
+        // added models are reported with all of their attributes anyway
+        if(bChangeTracking && _addedModels.find((ModelClass*)args.model) == _addedModels.end()){
+            if(args.model->isDirty())
+                _dirtyModels.insert((ModelClass*)args.model);
+            else
+                _dirtyModels.erase((ModelClass*)args.model);
+        }
+
         // trigger a "forward" event; anybody can hook into this event to be notified
         // about changes in any of the collection's models
-        ofNotifyEvent(modelChangedEvent, args, this);
+        notifyListeners(modelChangedEvent, args);
 
         // if one of our models changed and with the new changes no longer
         // passes our active filters; remove it
@@ -813,14 +2217,34 @@ namespace CMS {
 
     template <class ModelClass>
     void Collection<ModelClass>::onSyncSourceModelAdded(ModelClass &m){
+        TraceRecorder::Scope trace(_traceRecorder);
+
         // if our sync source gets a new model, we follow...
         // note that our add() function does apply all the active filters/rejections,
         // so the model might not actually end up in our collection
         add(&m);
     }
 
+    template <class ModelClass>
+    void Collection<ModelClass>::onSyncSourceModelsAdded(vector<ModelClass*> &models){
+        TraceRecorder::Scope trace(_traceRecorder);
+
+        // batches are passed on as batches; filters/rejections are applied to each model
+        addMany(models);
+    }
+
+    template <class ModelClass>
+    void Collection<ModelClass>::onSyncSourceModelsRemoved(vector<ModelClass*> &models){
+        TraceRecorder::Scope trace(_traceRecorder);
+
+        // removeMany ignores models that aren't in our collection
+        removeMany(models);
+    }
+
     template <class ModelClass>
     void Collection<ModelClass>::onSyncSourceModelChanged(AttrChangeArgs &args){
+        TraceRecorder::Scope trace(_traceRecorder);
+
         if(args.model == NULL){
             ofLogWarning() << "CMS::Collection::onSyncSourceModelChanged(AttrChangeArgs &) - got NULL model";
             return;
@@ -0,0 +1,235 @@
+//
+//  CMSColumnStore.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSColumnStore__
+#define __ofxCMS__CMSColumnStore__
+
+#include "ofMain.h"
+#include <unordered_map>
+#include "CMSIndex.h"
+
+namespace CMS {
+
+    // Columnar copy of a set of attributes of a collection's models; one contiguous
+    // column per attribute, with dictionary-encoded strings and a numeric (double) column
+    // for values that parse as numbers. Equality and range filters on these attributes
+    // then come down to tight loops over integers/doubles, instead of a string map lookup
+    // and string compare per model (see Collection::columns).
+    //
+    // Rows follow the order of the collection's models; removals (and shuffles) are applied
+    // lazily, by re-aligning the rows on the next query.
+    template<class ModelClass>
+    class ColumnStore : public Index<ModelClass>{
+
+    public: // methods
+
+        ColumnStore(const vector<string> &attrs) : _attrs(attrs), bAligned(true){
+            for(int i=0; i<_attrs.size(); i++){
+                _columns[_attrs[i]].dictionary[""] = EMPTY;
+                _columns[_attrs[i]].values.push_back("");
+            }
+        }
+
+        const vector<string> &attrs(){ return _attrs; }
+        bool hasColumn(const string &attr){ return _columns.find(attr) != _columns.end(); }
+        unsigned int rows(){ return _rowModels.size(); }
+
+        // number of distinct values in the column (including the empty value)
+        unsigned int cardinality(const string &attr){
+            typename map<string, Column>::iterator it = _columns.find(attr);
+            return it == _columns.end() ? 0 : it->second.values.size();
+        }
+
+        // make sure row i holds model i of the given vector
+        void align(const vector<ModelClass*> &models){
+            if(bAligned && _rowModels.size() == models.size()) return;
+
+            unsigned int count = models.size();
+
+            // all source rows first; the same model can be in there more than once
+            vector<unsigned int> sourceRows(count);
+            for(unsigned int i=0; i<count; i++){
+                typename std::unordered_map<ModelClass*, unsigned int>::const_iterator it = _rows.find(models[i]);
+                sourceRows[i] = it == _rows.end() ? (unsigned int)NO_ROW : it->second;
+            }
+
+            for(unsigned int i=0; i<count; i++){
+                if(sourceRows[i] != NO_ROW) _rows[models[i]] = i;
+            }
+
+            for(typename map<string, Column>::iterator it = _columns.begin(); it != _columns.end(); it++){
+                Column &column = it->second;
+                vector<unsigned int> codes(count);
+                vector<double> numbers(count);
+
+                for(unsigned int i=0; i<count; i++){
+                    if(sourceRows[i] == NO_ROW){
+                        codes[i] = EMPTY;
+                        numbers[i] = NAN;
+                    } else {
+                        codes[i] = column.codes[sourceRows[i]];
+                        numbers[i] = column.numbers[sourceRows[i]];
+                    }
+                }
+
+                column.codes.swap(codes);
+                column.numbers.swap(numbers);
+            }
+
+            _rowModels = models;
+            bAligned = true;
+        }
+
+        // rows were reordered
+        void invalidate(){ bAligned = false; }
+
+        // flags[row] = 1 when the row's value is one of the given values, 0 otherwise (or inverted)
+        void matchAny(const string &attr, const vector<string> &values, vector<char> &flags, bool invert = false){
+            Column &column = _columns[attr];
+            unsigned int count = column.codes.size();
+            const unsigned int *codes = column.codes.empty() ? NULL : &column.codes[0];
+
+            // lookup table by dictionary code
+            vector<char> wanted(column.values.size(), invert ? 1 : 0);
+            for(int i=0; i<values.size(); i++){
+                map<string, unsigned int>::iterator it = column.dictionary.find(values[i]);
+                if(it != column.dictionary.end()) wanted[it->second] = invert ? 0 : 1;
+            }
+
+            flags.resize(count);
+            char *out = flags.empty() ? NULL : &flags[0];
+            const char *lookup = &wanted[0];
+
+            for(unsigned int i=0; i<count; i++)
+                out[i] = lookup[codes[i]];
+        }
+
+        // flags[row] = 1 when the row's numeric value is within [min, max], 0 otherwise (or inverted);
+        // rows with non-numeric values are never within range
+        void matchRange(const string &attr, double min, double max, vector<char> &flags, bool invert = false){
+            Column &column = _columns[attr];
+            unsigned int count = column.numbers.size();
+            const double *numbers = column.numbers.empty() ? NULL : &column.numbers[0];
+
+            flags.resize(count);
+            char *out = flags.empty() ? NULL : &flags[0];
+
+            // NaN fails both comparisons
+            if(invert){
+                for(unsigned int i=0; i<count; i++)
+                    out[i] = !(numbers[i] >= min && numbers[i] <= max);
+            } else {
+                for(unsigned int i=0; i<count; i++)
+                    out[i] = numbers[i] >= min && numbers[i] <= max;
+            }
+        }
+
+        // numeric value of a string, NaN when it's not a number
+        static double toNumber(const string &value){
+            if(value.empty()) return NAN;
+            char *end = NULL;
+            double number = strtod(value.c_str(), &end);
+            return (end != NULL && *end == '\0') ? number : NAN;
+        }
+
+    public: // Index methods
+
+        void indexModel(ModelClass *model){
+            // appended rows stay aligned with the collection (which appends new models too)
+            unsigned int row = _rowModels.size();
+            _rowModels.push_back(model);
+            _rows[model] = row;
+
+            for(typename map<string, Column>::iterator it = _columns.begin(); it != _columns.end(); it++){
+                const string *value = model->lookup(it->first);
+                it->second.codes.push_back(value ? encode(it->second, *value) : EMPTY);
+                it->second.numbers.push_back(value ? toNumber(*value) : NAN);
+            }
+        }
+
+        void unindexModel(ModelClass *model){
+            typename std::unordered_map<ModelClass*, unsigned int>::iterator it = _rows.find(model);
+            if(it == _rows.end()) return;
+
+            // swap-remove; the rows get re-aligned with the collection on the next query
+            unsigned int row = it->second;
+            unsigned int last = _rowModels.size()-1;
+
+            if(row != last){
+                _rowModels[row] = _rowModels[last];
+                _rows[_rowModels[row]] = row;
+
+                for(typename map<string, Column>::iterator cit = _columns.begin(); cit != _columns.end(); cit++){
+                    cit->second.codes[row] = cit->second.codes[last];
+                    cit->second.numbers[row] = cit->second.numbers[last];
+                }
+            }
+
+            _rowModels.pop_back();
+            for(typename map<string, Column>::iterator cit = _columns.begin(); cit != _columns.end(); cit++){
+                cit->second.codes.pop_back();
+                cit->second.numbers.pop_back();
+            }
+
+            _rows.erase(model);
+            bAligned = false;
+        }
+
+        void updateModel(ModelClass *model, const string &attr, const string &value, const string &/* old_value */){
+            typename map<string, Column>::iterator cit = _columns.find(attr);
+            if(cit == _columns.end()) return;
+
+            typename std::unordered_map<ModelClass*, unsigned int>::iterator it = _rows.find(model);
+            if(it == _rows.end()) return;
+
+            cit->second.codes[it->second] = encode(cit->second, value);
+            cit->second.numbers[it->second] = toNumber(value);
+        }
+
+    protected: // types
+
+        class Column {
+        public:
+            // dictionary code per row
+            vector<unsigned int> codes;
+            // numeric value per row (NaN for non-numeric values)
+            vector<double> numbers;
+            // value -> code and code -> value
+            map<string, unsigned int> dictionary;
+            vector<string> values;
+        };
+
+        static const unsigned int EMPTY = 0;
+        // models that aren't in the store (see align)
+        static const unsigned int NO_ROW = 0xFFFFFFFF;
+
+    protected: // methods
+
+        unsigned int encode(Column &column, const string &value){
+            map<string, unsigned int>::iterator it = column.dictionary.find(value);
+            if(it != column.dictionary.end()) return it->second;
+
+            unsigned int code = column.values.size();
+            column.dictionary[value] = code;
+            column.values.push_back(value);
+            return code;
+        }
+
+    protected: // attributes
+
+        vector<string> _attrs;
+        map<string, Column> _columns;
+        vector<ModelClass*> _rowModels;
+        std::unordered_map<ModelClass*, unsigned int> _rows;
+        bool bAligned;
+
+    }; // class ColumnStore
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSColumnStore__) */
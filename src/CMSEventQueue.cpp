@@ -0,0 +1,75 @@
+//
+//  CMSEventQueue.cpp
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#include "CMSEventQueue.h"
+
+using namespace CMS;
+
+// plain pointer to the current thread's queue; models can outlive the queue (at exit)
+static thread_local EventQueue *tQueue = NULL;
+
+EventQueue::EventQueue() : bDeferred(false), bFlushing(false), mSequence(0){
+    tQueue = this;
+}
+
+EventQueue::~EventQueue(){
+    if(tQueue == this) tQueue = NULL;
+}
+
+EventQueue &EventQueue::current(){
+    static thread_local EventQueue queue;
+    return queue;
+}
+
+EventQueue* EventQueue::deferring(){
+    if(tQueue == NULL || !tQueue->bDeferred) return NULL;
+    return tQueue;
+}
+
+void EventQueue::destroyed(const void *object){
+    if(tQueue == NULL || (tQueue->_entries.empty() && !tQueue->bFlushing)) return;
+    tQueue->_dead[object] = tQueue->mSequence;
+}
+
+void EventQueue::setDeferred(bool deferred){
+    bDeferred = deferred;
+    if(!bDeferred) flush();
+}
+
+void EventQueue::flush(){
+    // flushEvents() from a listener; the running flush gets to the new notifications anyway
+    if(bFlushing) return;
+    bFlushing = true;
+
+    vector<Entry> entries;
+
+    while(!_entries.empty()){
+        entries.clear();
+        entries.swap(_entries);
+        // notifications fired from here on are queued behind these
+        _changes.clear();
+
+        for(size_t i=0; i<entries.size(); i++){
+            Entry &entry = entries[i];
+            if(isDead(entry.sender, entry.sequence) || (entry.model && isDead(entry.model, entry.sequence))) continue;
+            entry.dispatch();
+        }
+    }
+
+    _dead.clear();
+    bFlushing = false;
+}
+
+void EventQueue::add(const void *sender, const void *model, const std::function<void()> &dispatch){
+    Entry entry;
+    entry.sender = sender;
+    entry.model = model;
+    entry.sequence = mSequence++;
+    entry.dispatch = dispatch;
+    _entries.push_back(entry);
+}
@@ -0,0 +1,198 @@
+//
+//  CMSEventQueue.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSEventQueue__
+#define __ofxCMS__CMSEventQueue__
+
+#include "ofMain.h"
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include "CMSModel.h"
+
+namespace CMS {
+
+    // Per-thread queue for deferred event dispatch. By default, models and collections notify
+    // their listeners right away, inside the call that triggered the notification. Once the
+    // current thread's queue is deferring, their notifications are queued instead and delivered
+    // at the next flushEvents() (for example once per frame, in update()); notifications that
+    // are fired while flushing are delivered by that same flush.
+    //
+    // Changes of the same attribute of the same model (attributeChangedEvent, modelChangedEvent)
+    // are coalesced into a single notification, with the first old_value and the last value;
+    // changes that end up where they started are dropped. Notifications about models or
+    // collections that are deleted before the flush are dropped as well.
+    //
+    // Not deferred: Model::beforeDestroyEvent, Model::immediateAttributeChangedEvent (which is
+    // what collections use to keep their filters and indexes up-to-date) and
+    // Collection::collectionDestroyingEvent. Syncing collections (see Collection::syncsFrom)
+    // listen to their source's notifications, so they catch up when the queue is flushed.
+    //
+    // Models and collections should be used (and deleted) on the thread that owns the queue.
+    //
+    // Usage:
+    //
+    //  CMS::EventQueue::current().setDeferred(true);
+    //  ...
+    //  void ofApp::update(){
+    //      CMS::flushEvents();
+    //  }
+    //
+    class EventQueue {
+
+    public: // methods
+
+        // the current thread's queue (the only way to get one)
+        static EventQueue &current();
+        // the current thread's queue if it's deferring, NULL otherwise
+        static EventQueue* deferring();
+        // drops queued notifications from or about the given model/collection, which is going away
+        static void destroyed(const void *object);
+
+        // disabling delivers whatever is still queued
+        void setDeferred(bool deferred);
+        bool isDeferred(){ return bDeferred; }
+
+        // delivers all queued notifications, including the ones fired while delivering
+        void flush();
+        unsigned int size(){ return _entries.size(); }
+
+    public: // queueing methods (used by Model and Collection)
+
+        template<class SenderType>
+        void post(ofEvent<void> &event, SenderType *sender){
+            add(sender, NULL, [&event, sender](){ ofNotifyEvent(event, sender); });
+        }
+
+        // notification with a model as its argument
+        template<class ModelType, class SenderType>
+        void postModel(ofEvent<ModelType> &event, ModelType &model, SenderType *sender){
+            ModelType *ptr = &model;
+            add(sender, static_cast<Model*>(ptr), [&event, ptr, sender](){ ofNotifyEvent(event, *ptr, sender); });
+        }
+
+        // notification with a batch of models as its argument; models that are gone are left out
+        template<class ModelType, class SenderType>
+        void postModels(ofEvent< vector<ModelType*> > &event, vector<ModelType*> &models, SenderType *sender){
+            std::shared_ptr< vector<ModelType*> > batch(new vector<ModelType*>(models));
+            unsigned long long sequence = mSequence;
+            add(sender, NULL, [this, &event, batch, sender, sequence](){
+                if(!_dead.empty()){
+                    int count = 0;
+                    for(int i=0; i<batch->size(); i++){
+                        if(!isDead(static_cast<Model*>((*batch)[i]), sequence)) (*batch)[count++] = (*batch)[i];
+                    }
+                    batch->resize(count);
+                    if(batch->empty()) return;
+                }
+                ofNotifyEvent(event, *batch, sender);
+            });
+        }
+
+        // notification with the sender itself as its argument
+        template<class SenderType>
+        void postSender(ofEvent<SenderType> &event, SenderType *sender){
+            add(sender, NULL, [&event, sender](){ ofNotifyEvent(event, *sender, sender); });
+        }
+
+        // attribute change notification; coalesced with a queued change of the same attribute
+        // of the same model for the same event
+        template<class SenderType>
+        void postChange(ofEvent<AttrChangeArgs> &event, const AttrChangeArgs &args, SenderType *sender){
+            ChangeKey key(&event, args.model, args.attr);
+            map<ChangeKey, Change>::iterator it = _changes.find(key);
+
+            if(it != _changes.end() && !isDead(args.model, it->second.sequence) && !isDead(sender, it->second.sequence)){
+                it->second.args->value = args.value;
+
+                // back where it started; nothing happened
+                if(it->second.args->value == it->second.args->old_value){
+                    *it->second.cancelled = true;
+                    _changes.erase(it);
+                }
+                return;
+            }
+
+            std::shared_ptr<AttrChangeArgs> change(new AttrChangeArgs(args));
+            std::shared_ptr<bool> cancelled(new bool(false));
+            _changes[key] = Change(change, cancelled, mSequence);
+            add(sender, args.model, [&event, change, cancelled, sender](){
+                if(!*cancelled) ofNotifyEvent(event, *change, sender);
+            });
+        }
+
+    protected: // types
+
+        class Entry {
+        public:
+            const void *sender;
+            // model the notification is about (if any)
+            const void *model;
+            unsigned long long sequence;
+            std::function<void()> dispatch;
+        };
+
+        class ChangeKey {
+        public:
+            ChangeKey(const void *e, const void *m, const string &a) : event(e), model(m), attr(a){}
+            bool operator<(const ChangeKey &other) const {
+                if(event != other.event) return event < other.event;
+                if(model != other.model) return model < other.model;
+                return attr < other.attr;
+            }
+            const void *event, *model;
+            string attr;
+        };
+
+        class Change {
+        public:
+            Change() : sequence(0){}
+            Change(const std::shared_ptr<AttrChangeArgs> &a, const std::shared_ptr<bool> &c, unsigned long long s) : args(a), cancelled(c), sequence(s){}
+            std::shared_ptr<AttrChangeArgs> args;
+            std::shared_ptr<bool> cancelled;
+            unsigned long long sequence;
+        };
+
+    private: // methods
+
+        // see current()
+        EventQueue();
+        ~EventQueue();
+        EventQueue(const EventQueue &);
+        EventQueue &operator=(const EventQueue &);
+
+    protected: // methods
+
+        void add(const void *sender, const void *model, const std::function<void()> &dispatch);
+        // true when the object was destroyed after the notification with the given sequence number was queued
+        bool isDead(const void *object, unsigned long long sequence){
+            if(_dead.empty()) return false;
+            std::unordered_map<const void*, unsigned long long>::iterator it = _dead.find(object);
+            return it != _dead.end() && it->second > sequence;
+        }
+
+    protected: // attributes
+
+        bool bDeferred;
+        bool bFlushing;
+        vector<Entry> _entries;
+        // queued attribute changes, for coalescing
+        map<ChangeKey, Change> _changes;
+        // destroyed senders and models, with the sequence number at the time they were destroyed
+        // (a new object can end up at the same address)
+        std::unordered_map<const void*, unsigned long long> _dead;
+        unsigned long long mSequence;
+
+    }; // class EventQueue
+
+    // delivers the current thread's queued notifications (see EventQueue)
+    inline void flushEvents(){ EventQueue::current().flush(); }
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSEventQueue__) */
@@ -0,0 +1,129 @@
+//
+//  CMSFacet.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSFacet__
+#define __ofxCMS__CMSFacet__
+
+#include "ofMain.h"
+#include <unordered_map>
+#include "CMSIndex.h"
+
+namespace CMS {
+
+    // Group-by counts for a single attribute (value -> number of models with that value),
+    // kept up-to-date by the collection it belongs to (see Collection::facet) so reading
+    // a count doesn't require scanning the collection.
+    // Models that don't have the attribute (or have an empty value) are not counted.
+    template<class ModelClass>
+    class Facet : public Index<ModelClass>{
+
+    public: // methods
+
+        Facet(const string &attr, bool trackModels = false) : mAttr(attr), bTrackModels(trackModels){}
+
+        const string &attr(){ return mAttr; }
+        bool tracksModels(){ return bTrackModels; }
+
+        // starts tracking models (see models()), given the models that are currently counted
+        void trackModels(const vector<ModelClass*> &models){
+            if(bTrackModels) return;
+            bTrackModels = true;
+
+            for(int i=0; i<models.size(); i++){
+                const string *value = models[i]->lookup(mAttr);
+                if(value && !value->empty()) _models[*value].push_back(models[i]);
+            }
+        }
+
+        // number of models with the given value
+        int count(const string &value){
+            std::unordered_map<string, int>::iterator it = _counts.find(value);
+            return it == _counts.end() ? 0 : it->second;
+        }
+
+        // all values with their counts (in no particular order)
+        const std::unordered_map<string, int> &counts(){ return _counts; }
+
+        // number of distinct values
+        unsigned int size(){ return _counts.size(); }
+
+        // the (max) k values with the highest counts, highest first
+        vector< pair<string, int> > top(unsigned int k){
+            vector< pair<string, int> > result(_counts.begin(), _counts.end());
+            k = std::min(k, (unsigned int)result.size());
+            std::partial_sort(result.begin(), result.begin() + k, result.end(), &Facet<ModelClass>::compareCounts);
+            result.resize(k);
+            return result;
+        }
+
+        // models with the given value (only available when tracking models, see constructor)
+        const vector<ModelClass*> &models(const string &value){
+            static const vector<ModelClass*> empty;
+            typename std::unordered_map<string, vector<ModelClass*> >::iterator it = _models.find(value);
+            return it == _models.end() ? empty : it->second;
+        }
+
+    public: // Index methods
+
+        void indexModel(ModelClass *model){
+            const string *value = model->lookup(mAttr);
+            if(value) increment(model, *value);
+        }
+
+        void unindexModel(ModelClass *model){
+            const string *value = model->lookup(mAttr);
+            if(value) decrement(model, *value);
+        }
+
+        void updateModel(ModelClass *model, const string &attr, const string &value, const string &old_value){
+            if(attr != mAttr) return;
+            decrement(model, old_value);
+            increment(model, value);
+        }
+
+    protected: // methods
+
+        void increment(ModelClass *model, const string &value){
+            if(value.empty()) return;
+            _counts[value]++;
+            if(bTrackModels) _models[value].push_back(model);
+        }
+
+        void decrement(ModelClass *model, const string &value){
+            std::unordered_map<string, int>::iterator it = _counts.find(value);
+            if(it == _counts.end()) return;
+
+            if(--it->second <= 0) _counts.erase(it);
+
+            if(bTrackModels){
+                typename std::unordered_map<string, vector<ModelClass*> >::iterator mit = _models.find(value);
+                if(mit == _models.end()) return;
+
+                typename vector<ModelClass*>::iterator pos = std::find(mit->second.begin(), mit->second.end(), model);
+                if(pos != mit->second.end()) mit->second.erase(pos);
+                if(mit->second.empty()) _models.erase(mit);
+            }
+        }
+
+        // highest count first, alphabetically for equal counts
+        static bool compareCounts(const pair<string, int> &a, const pair<string, int> &b){
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        }
+
+    protected: // attributes
+
+        string mAttr;
+        bool bTrackModels;
+        std::unordered_map<string, int> _counts;
+        std::unordered_map<string, vector<ModelClass*> > _models;
+
+    }; // class Facet
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSFacet__) */
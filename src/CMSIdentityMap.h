@@ -0,0 +1,121 @@
+//
+//  CMSIdentityMap.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSIdentityMap__
+#define __ofxCMS__CMSIdentityMap__
+
+#include "ofMain.h"
+
+namespace CMS {
+
+    // Registry of models by id (Model::id()) that can be shared by multiple collections,
+    // so the same record loaded into several (independent) collections ends up as one
+    // single model instance instead of a copy per collection.
+    //
+    // Every collection that uses the identity map holds a reference on each of its models;
+    // a model is only deleted when the last owning collection releases it.
+    //
+    // Usage:
+    //
+    //  CMS::IdentityMap<CMS::Model> registry;
+    //  feedA.setIdentityMap(&registry);
+    //  feedB.setIdentityMap(&registry);
+    //  feedA.parse(jsonA);
+    //  feedB.parse(jsonB); // records that are also in feedA are re-used
+    //
+    template<class ModelClass>
+    class IdentityMap{
+
+    public: // methods
+
+        ~IdentityMap(){
+            // we don't delete anything here; the models are owned by the collections
+            _models.clear();
+            _refCounts.clear();
+        }
+
+        // returns the registered model for the given id, or NULL if no such model is registered
+        ModelClass* find(const string &_id){
+            typename map<string, ModelClass*>::iterator it = _models.find(_id);
+            return it == _models.end() ? NULL : it->second;
+        }
+
+        bool has(ModelClass *model){
+            return model != NULL && _refCounts.find(model) != _refCounts.end();
+        }
+
+        // adds a reference to the model, registers it if it wasn't registered yet
+        void retain(ModelClass *model){
+            if(model == NULL) return;
+
+            typename map<ModelClass*, int>::iterator it = _refCounts.find(model);
+            if(it != _refCounts.end()){
+                it->second++;
+                return;
+            }
+
+            _refCounts[model] = 1;
+            // don't override a different instance that's already registered under the same id
+            if(find(model->id()) == NULL)
+                _models[model->id()] = model;
+        }
+
+        // removes a reference to the model, returns true when this was the last reference,
+        // in which case the model is unregistered and the caller becomes its (sole) owner
+        bool release(ModelClass *model){
+            typename map<ModelClass*, int>::iterator it = _refCounts.find(model);
+
+            if(it == _refCounts.end()){
+                // not registered (anymore); nobody else is holding on to it
+                return true;
+            }
+
+            it->second--;
+            if(it->second > 0) return false;
+
+            _refCounts.erase(it);
+            unregister(model);
+            return true;
+        }
+
+        int refCount(ModelClass *model){
+            typename map<ModelClass*, int>::iterator it = _refCounts.find(model);
+            return it == _refCounts.end() ? 0 : it->second;
+        }
+
+        unsigned int count(){ return _refCounts.size(); }
+
+    protected: // methods
+
+        void unregister(ModelClass *model){
+            // the model's id might have changed since it was registered,
+            // so we look for the pointer instead of the id
+            typename map<string, ModelClass*>::iterator it = _models.find(model->id());
+            if(it != _models.end() && it->second == model){
+                _models.erase(it);
+                return;
+            }
+
+            for(it = _models.begin(); it != _models.end(); it++){
+                if(it->second == model){
+                    _models.erase(it);
+                    return;
+                }
+            }
+        }
+
+    protected: // attributes
+
+        map<string, ModelClass*> _models;
+        map<ModelClass*, int> _refCounts;
+
+    }; // class IdentityMap
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSIdentityMap__) */
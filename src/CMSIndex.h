@@ -0,0 +1,37 @@
+//
+//  CMSIndex.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSIndex__
+#define __ofxCMS__CMSIndex__
+
+#include "ofMain.h"
+
+namespace CMS {
+
+    // Base class for structures that a Collection keeps up-to-date incrementally
+    // (facet counts, search indexes, ...). Once attached to a collection (see Collection::addIndex)
+    // the collection calls these methods whenever a model enters or leaves the collection
+    // or when one of its models' attributes changes.
+    template<class ModelClass>
+    class Index{
+
+    public:
+        virtual ~Index(){}
+
+        // model was added to the collection
+        virtual void indexModel(ModelClass *model) = 0;
+        // model was removed from the collection
+        virtual void unindexModel(ModelClass *model) = 0;
+        // attribute of one of the collection's models changed
+        virtual void updateModel(ModelClass *model, const string &attr, const string &value, const string &old_value) = 0;
+
+    }; // class Index
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSIndex__) */
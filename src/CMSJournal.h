@@ -0,0 +1,414 @@
+//
+//  CMSJournal.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSJournal__
+#define __ofxCMS__CMSJournal__
+
+#include "ofMain.h"
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#ifdef TARGET_WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+#include "CMSCollection.h"
+
+namespace CMS {
+
+    // Append-only journal of a collection's changes (added, removed and changed models),
+    // so its content can be restored locally after a restart or crash, instead of
+    // re-downloading and re-parsing everything.
+    //
+    // Records are written in the change feed format of Collection::applyChanges, to the
+    // journal file. Writes are flushed and fsync'ed in batches (every syncBatchSize records,
+    // or on the first record after syncInterval ms); call sync() to force this (for example
+    // once per frame). Once the journal grows beyond the compaction threshold (and the size of
+    // the last snapshot), the collection's content is written to a snapshot file (in the same
+    // format) and the journal starts over; the snapshot file is written in a background thread.
+    //
+    // Recovery replays the snapshot, then the journal. Models should have an id (Model::id()
+    // other than the cid) to survive a recovery.
+    //
+    // Added models are journaled with all of their attributes, so lazily parsed models
+    // (see Collection::setLazyParsing) are decoded right away in a journaled collection.
+    //
+    // Usage:
+    //
+    //  CMS::Journal<CMS::Model> journal("records.journal");
+    //  journal.open(records); // restores records, then starts journaling its changes
+    //
+    template<class ModelClass>
+    class Journal : public Index<ModelClass>{
+
+    public: // methods
+
+        const static size_t DEFAULT_COMPACT_THRESHOLD = 4 * 1024 * 1024;
+        const static unsigned int DEFAULT_SYNC_BATCH_SIZE = 64;
+        const static unsigned int DEFAULT_SYNC_INTERVAL = 100;
+
+        Journal(const string &path, size_t compactThreshold = DEFAULT_COMPACT_THRESHOLD) : mPath(ofToDataPath(path, true)), mCompactThreshold(compactThreshold),
+            mSyncBatchSize(DEFAULT_SYNC_BATCH_SIZE), mSyncInterval(DEFAULT_SYNC_INTERVAL), _collection(NULL), bAttaching(false), mFile(NULL),
+            mBytes(0), mSnapshotBytes(0), mPending(0), mLastSync(0), bCompacting(false){}
+
+        ~Journal(){
+            close();
+        }
+
+        // restores the collection's content from the snapshot and journal files (if any),
+        // then starts journaling the collection's changes. Returns the number of replayed records
+        unsigned int open(Collection<ModelClass> &collection){
+            close();
+
+            bool hadModels = collection.count() > 0;
+            unsigned int count = 0;
+            count += replay(collection, snapshotPath());
+            // leftover of a compaction that didn't finish
+            bool leftover = ofFile::doesFileExist(rotatedPath(), false);
+            count += replay(collection, rotatedPath());
+            count += replay(collection, mPath);
+
+            if(!openFile()) return count;
+
+            _collection = &collection;
+            // this calls indexModel for all current models, which shouldn't be journaled again
+            bAttaching = true;
+            _collection->addIndex(this);
+            bAttaching = false;
+            ofAddListener(_collection->collectionDestroyingEvent, this, &Journal<ModelClass>::onCollectionDestroying);
+
+            if(leftover){
+                // the rotated journal can't be rotated over; write a new snapshot right away
+                writeSnapshot(serialize(), snapshotPath(), rotatedPath());
+            } else if(hadModels){
+                // capture whatever was in the collection before we got here
+                compact();
+            }
+
+            return count;
+        }
+
+        // stops journaling; flushes and syncs pending records and waits for a running compaction
+        void close(){
+            if(_collection){
+                ofRemoveListener(_collection->collectionDestroyingEvent, this, &Journal<ModelClass>::onCollectionDestroying);
+                _collection->removeIndex(this);
+                _collection = NULL;
+            }
+
+            if(mFile){
+                sync();
+                fclose(mFile);
+                mFile = NULL;
+            }
+
+            waitForCompaction();
+            _ids.clear();
+        }
+
+        // flushes pending records to the journal file and fsyncs it
+        void sync(){
+            if(mFile == NULL) return;
+            fflush(mFile);
+#ifdef TARGET_WIN32
+            _commit(_fileno(mFile));
+#else
+            fsync(fileno(mFile));
+#endif
+            mPending = 0;
+            mLastSync = ofGetElapsedTimeMillis();
+        }
+
+        // writes the collection's current content to the snapshot file (in a background thread)
+        // and starts a new journal
+        void compact(){
+            if(_collection == NULL || mFile == NULL) return;
+
+            // one at a time; the rotated journal has to be gone before we rotate again
+            waitForCompaction();
+
+            // the models can only be read on our thread
+            string snapshot = serialize();
+
+            // a previous snapshot couldn't be written; its rotated journal can only go
+            // once there's a complete snapshot, so try again right here
+            if(ofFile::doesFileExist(rotatedPath(), false)){
+                writeSnapshot(snapshot, snapshotPath(), rotatedPath());
+                if(ofFile::doesFileExist(rotatedPath(), false)) return;
+            }
+
+            sync();
+            fclose(mFile);
+            mFile = NULL;
+            std::rename(mPath.c_str(), rotatedPath().c_str());
+            openFile();
+
+            bCompacting = true;
+            mCompactor = std::thread([this, snapshot](){
+                writeSnapshot(snapshot, snapshotPath(), rotatedPath());
+                bCompacting = false;
+            });
+        }
+
+        bool isCompacting(){ return bCompacting; }
+        void waitForCompaction(){
+            if(mCompactor.joinable()) mCompactor.join();
+        }
+
+        void setCompactThreshold(size_t bytes){ mCompactThreshold = bytes; }
+        size_t getCompactThreshold(){ return mCompactThreshold; }
+        void setSyncBatchSize(unsigned int records){ mSyncBatchSize = records; }
+        void setSyncInterval(unsigned int ms){ mSyncInterval = ms; }
+
+        // size of the current journal file in bytes
+        size_t size(){ return mBytes; }
+        const string &getPath(){ return mPath; }
+        string snapshotPath(){ return mPath + ".snapshot"; }
+
+    public: // Index methods
+
+        void indexModel(ModelClass *model){
+            _ids[model] = model->id();
+            if(bAttaching) return;
+            upsertRecord(mRecord, model->id(), model->attributes());
+            append();
+        }
+
+        void unindexModel(ModelClass *model){
+            typename map<ModelClass*, string>::iterator it = _ids.find(model);
+            if(it == _ids.end()) return;
+            deleteRecord(mRecord, it->second);
+            // gone before append() gets to compact
+            _ids.erase(it);
+            append();
+        }
+
+        void updateModel(ModelClass *model, const string &attr, const string &value, const string &old_value){
+            typename map<ModelClass*, string>::iterator it = _ids.find(model);
+            if(it == _ids.end()) return;
+
+            // the model's id changed; replace the old record
+            if(it->second != model->id()){
+                deleteRecord(mRecord, it->second);
+                it->second = model->id();
+                upsertRecord(mRecord, it->second, model->attributes());
+                append();
+                return;
+            }
+
+            upsertRecord(mRecord, it->second, attr, value);
+            append();
+        }
+
+    protected: // methods
+
+        string rotatedPath(){ return mPath + ".old"; }
+
+        bool openFile(){
+            mFile = fopen(mPath.c_str(), "ab");
+
+            if(mFile == NULL){
+                ofLogError() << "CMS::Journal - couldn't open journal file: " << mPath;
+                return false;
+            }
+
+            fseek(mFile, 0, SEEK_END);
+            mBytes = ftell(mFile);
+            mPending = 0;
+            return true;
+        }
+
+        unsigned int replay(Collection<ModelClass> &collection, const string &path){
+            ofBuffer buffer = ofBufferFromFile(path, true);
+            if(buffer.size() == 0) return 0;
+
+            if(path == snapshotPath()) mSnapshotBytes = buffer.size();
+
+            // we write attribute values as json strings, which parse() would take as json
+            bool verbatim = collection.bVerbatimStrings;
+            collection.bVerbatimStrings = true;
+            ChangeFeedResult result = collection.applyChanges(buffer.getText());
+            collection.bVerbatimStrings = verbatim;
+
+            ofLogVerbose() << "CMS::Journal - replayed " << path << ": " << result.upserted << " upserts, " << result.deleted << " deletes";
+            return result.upserted + result.deleted + result.skipped;
+        }
+
+        // writes (and clears) the pending record(s) in mRecord
+        void append(){
+            if(mFile == NULL){
+                mRecord.clear();
+                return;
+            }
+
+            fwrite(mRecord.data(), 1, mRecord.size(), mFile);
+            mBytes += mRecord.size();
+            mRecord.clear();
+            mPending++;
+
+            if(mPending >= mSyncBatchSize || ofGetElapsedTimeMillis() - mLastSync >= mSyncInterval)
+                sync();
+
+            // compacting more often than the snapshot's size would make
+            // journaling a growing collection quadratic
+            if(mBytes > mCompactThreshold && mBytes > mSnapshotBytes && !bCompacting)
+                compact();
+        }
+
+        // the models we journaled, in the collection's order. We can be called in the middle of
+        // a collection operation (removeMany compacts the models in place, so the collection
+        // can hold duplicates and models that we already journaled as deleted)
+        string serialize(){
+            string snapshot;
+            set<ModelClass*> written;
+
+            const vector<ModelClass*> &models = _collection->models();
+            for(int i=0; i<models.size(); i++){
+                typename map<ModelClass*, string>::iterator it = _ids.find(models[i]);
+                if(it == _ids.end() || !written.insert(models[i]).second) continue;
+                upsertRecord(snapshot, it->second, models[i]->attributes());
+            }
+
+            // anything the collection doesn't hold (anymore) at this point
+            for(typename map<ModelClass*, string>::iterator it = _ids.begin(); it != _ids.end() && written.size() < _ids.size(); it++){
+                if(written.insert(it->first).second) upsertRecord(snapshot, it->second, it->first->attributes());
+            }
+
+            mSnapshotBytes = snapshot.size();
+            return snapshot;
+        }
+
+        // writes the snapshot to a temporary file first and renames it when it's complete,
+        // so there's always a complete snapshot on disk; then the rotated journal can go
+        static void writeSnapshot(const string &snapshot, const string &path, const string &rotatedPath){
+            string tmpPath = path + ".tmp";
+            FILE *file = fopen(tmpPath.c_str(), "wb");
+
+            if(file == NULL){
+                ofLogError() << "CMS::Journal - couldn't write snapshot file: " << tmpPath;
+                return;
+            }
+
+            bool ok = fwrite(snapshot.data(), 1, snapshot.size(), file) == snapshot.size();
+            ok = fflush(file) == 0 && ok;
+#ifdef TARGET_WIN32
+            _commit(_fileno(file));
+#else
+            fsync(fileno(file));
+#endif
+            fclose(file);
+
+            if(!ok){
+                ofLogError() << "CMS::Journal - couldn't write snapshot file: " << tmpPath;
+                return;
+            }
+
+#ifdef TARGET_WIN32
+            // rename doesn't replace existing files on windows
+            std::remove(path.c_str());
+#endif
+            if(std::rename(tmpPath.c_str(), path.c_str()) != 0){
+                ofLogError() << "CMS::Journal - couldn't replace snapshot file: " << path;
+                return;
+            }
+
+            std::remove(rotatedPath.c_str());
+        }
+
+        // records are written by hand; building a Json::Value per record is a lot slower
+
+        static void upsertRecord(string &out, const string &_id, const map<string, string> &attrs){
+            out += "{\"op\":\"upsert\",\"id\":";
+            appendJsonString(out, _id);
+            out += ",\"attrs\":{";
+            for(map<string, string>::const_iterator it = attrs.begin(); it != attrs.end(); it++){
+                if(it != attrs.begin()) out += ',';
+                appendJsonString(out, it->first);
+                out += ':';
+                appendJsonString(out, it->second);
+            }
+            out += "}}\n";
+        }
+
+        static void upsertRecord(string &out, const string &_id, const string &attr, const string &value){
+            out += "{\"op\":\"upsert\",\"id\":";
+            appendJsonString(out, _id);
+            out += ",\"attrs\":{";
+            appendJsonString(out, attr);
+            out += ':';
+            appendJsonString(out, value);
+            out += "}}\n";
+        }
+
+        static void deleteRecord(string &out, const string &_id){
+            out += "{\"op\":\"delete\",\"id\":";
+            appendJsonString(out, _id);
+            out += "}\n";
+        }
+
+        static void appendJsonString(string &out, const string &str){
+            out += '"';
+            for(int i=0; i<str.size(); i++){
+                char c = str[i];
+                switch(c){
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default:
+                        if((unsigned char)c < 0x20){
+                            char escaped[8];
+                            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+                            out += escaped;
+                        } else {
+                            out += c;
+                        }
+                }
+            }
+            out += '"';
+        }
+
+    protected: // callbacks
+
+        void onCollectionDestroying(Collection<ModelClass> &collection){
+            // don't journal the collection's destruction (it removes all of its models)
+            ofRemoveListener(_collection->collectionDestroyingEvent, this, &Journal<ModelClass>::onCollectionDestroying);
+            _collection->removeIndex(this);
+            _collection = NULL;
+        }
+
+    protected: // attributes
+
+        string mPath;
+        size_t mCompactThreshold;
+        unsigned int mSyncBatchSize;
+        unsigned int mSyncInterval;
+
+        Collection<ModelClass> *_collection;
+        // id per journaled model, to detect id changes
+        map<ModelClass*, string> _ids;
+        bool bAttaching;
+
+        FILE *mFile;
+        // record(s) being written
+        string mRecord;
+        size_t mBytes;
+        size_t mSnapshotBytes;
+        unsigned int mPending;
+        unsigned long long mLastSync;
+
+        std::thread mCompactor;
+        std::atomic<bool> bCompacting;
+
+    }; // class Journal
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSJournal__) */
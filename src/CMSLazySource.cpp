@@ -0,0 +1,213 @@
+//
+//  CMSLazySource.cpp
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#include "CMSLazySource.h"
+
+using namespace CMS;
+
+LazySource::~LazySource(){
+    // models can outlive us; they'd better have all of their attributes
+    while(!_entries.empty()){
+        materialize(_entries.begin()->first);
+    }
+}
+
+void LazySource::attach(Model *model, const std::shared_ptr<const string> &buffer, const Slice &record, const std::shared_ptr<const set<string> > &eagerAttrs){
+    if(model->getAttributeSource() != NULL && model->getAttributeSource() != this){
+        ofLogWarning() << "CMS::LazySource - model (id=" << model->id() << ") already has an attribute source, loading all of its attributes";
+        Entry entry;
+        entry.buffer = buffer;
+        entry.record = record;
+        load(model, entry);
+        return;
+    }
+
+    Entry &entry = _entries[model];
+    entry.buffer = buffer;
+    entry.record = record;
+    entry.eagerAttrs = eagerAttrs;
+    model->setAttributeSource(this);
+}
+
+void LazySource::materialize(Model *model){
+    std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+    if(it == _entries.end()) return;
+
+    // detach first; load() shouldn't end up back here
+    Entry entry = it->second;
+    _entries.erase(it);
+    model->setAttributeSource(NULL);
+    load(model, entry);
+}
+
+void LazySource::release(Model *model){
+    std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+    if(it == _entries.end()) return;
+
+    _entries.erase(it);
+    model->setAttributeSource(NULL);
+}
+
+void LazySource::access(Model *model, const string *attr){
+    std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+    if(it == _entries.end()) return;
+
+    // eager attributes are already there (if the record has them at all)
+    if(attr && it->second.eagerAttrs && it->second.eagerAttrs->find(*attr) != it->second.eagerAttrs->end()) return;
+
+    materialize(model);
+}
+
+void LazySource::load(Model *model, Entry &entry){
+    const string &text = *entry.buffer;
+    vector<Member> members;
+
+    if(!splitObject(text, entry.record, members)){
+        ofLogWarning() << "CMS::LazySource - invalid json record for model (id=" << model->id() << "): " << text.substr(entry.record.begin, entry.record.size());
+        return;
+    }
+
+    map<string, string> &attrs = attributesOf(model);
+
+    for(size_t i=0; i<members.size(); i++){
+        // eager attributes were decoded already (and might have been changed since)
+        if(entry.eagerAttrs && entry.eagerAttrs->find(members[i].key) != entry.eagerAttrs->end()) continue;
+        // don't override anything that was set in the meantime
+        if(attrs.find(members[i].key) != attrs.end()) continue;
+
+        loadAttribute(model, members[i].key, decode(text, members[i].value));
+    }
+}
+
+string LazySource::decode(const string &text, const Slice &value){
+    // plain strings (without escape sequences) don't need a json parser
+    if(value.size() >= 2 && text[value.begin] == '"'){
+        size_t escape = text.find('\\', value.begin);
+        if(escape == string::npos || escape >= value.end)
+            return text.substr(value.begin+1, value.size()-2);
+    }
+
+    Json::Reader reader;
+    Json::Value json;
+    if(!reader.parse(text.data() + value.begin, text.data() + value.end, json, false)){
+        ofLogWarning() << "CMS::LazySource - couldn't parse json value: " << text.substr(value.begin, value.size());
+        return "";
+    }
+
+    return mConvert(json);
+}
+
+bool LazySource::splitArray(const string &text, vector<Slice> &elements){
+    size_t end = text.size();
+    size_t pos = skipWhitespace(text, 0, end);
+    if(pos >= end || text[pos] != '[') return false;
+
+    pos = skipWhitespace(text, pos+1, end);
+    if(pos < end && text[pos] == ']') return skipWhitespace(text, pos+1, end) == end;
+
+    while(pos < end){
+        size_t valueEnd = skipValue(text, pos, end);
+        if(valueEnd == string::npos) return false;
+        elements.push_back(Slice(pos, valueEnd));
+
+        pos = skipWhitespace(text, valueEnd, end);
+        if(pos >= end) return false;
+        if(text[pos] == ']') return skipWhitespace(text, pos+1, end) == end;
+        if(text[pos] != ',') return false;
+        pos = skipWhitespace(text, pos+1, end);
+    }
+
+    return false;
+}
+
+bool LazySource::splitObject(const string &text, const Slice &object, vector<Member> &members){
+    size_t end = object.end;
+    size_t pos = skipWhitespace(text, object.begin, end);
+    if(pos >= end || text[pos] != '{') return false;
+
+    pos = skipWhitespace(text, pos+1, end);
+    if(pos < end && text[pos] == '}') return true;
+
+    while(pos < end){
+        if(text[pos] != '"') return false;
+        size_t keyEnd = skipValue(text, pos, end);
+        if(keyEnd == string::npos) return false;
+
+        Member member;
+        // keys with escape sequences go through the json parser
+        size_t escape = text.find('\\', pos);
+        if(escape == string::npos || escape >= keyEnd){
+            member.key = text.substr(pos+1, keyEnd-pos-2);
+        } else {
+            Json::Reader reader;
+            Json::Value key;
+            if(!reader.parse(text.data() + pos, text.data() + keyEnd, key, false)) return false;
+            member.key = key.asString();
+        }
+
+        pos = skipWhitespace(text, keyEnd, end);
+        if(pos >= end || text[pos] != ':') return false;
+        pos = skipWhitespace(text, pos+1, end);
+
+        size_t valueEnd = skipValue(text, pos, end);
+        if(valueEnd == string::npos) return false;
+        member.value = Slice(pos, valueEnd);
+        members.push_back(member);
+
+        pos = skipWhitespace(text, valueEnd, end);
+        if(pos >= end) return false;
+        if(text[pos] == '}') return true;
+        if(text[pos] != ',') return false;
+        pos = skipWhitespace(text, pos+1, end);
+    }
+
+    return false;
+}
+
+size_t LazySource::skipValue(const string &text, size_t pos, size_t end){
+    if(pos >= end) return string::npos;
+
+    const char *data = text.data();
+    char c = data[pos];
+
+    if(c == '"'){
+        for(size_t i=pos+1; i<end; i++){
+            if(data[i] == '\\') i++;
+            else if(data[i] == '"') return i+1;
+        }
+        return string::npos;
+    }
+
+    if(c == '{' || c == '['){
+        // skip the whole (nested) structure; strings might contain brackets
+        int depth = 0;
+        for(size_t i=pos; i<end; i++){
+            char d = data[i];
+            if(d == '"'){
+                i = skipValue(text, i, end);
+                if(i == string::npos) return string::npos;
+                i--;
+            } else if(d == '{' || d == '['){
+                depth++;
+            } else if(d == '}' || d == ']'){
+                if(--depth == 0) return i+1;
+            }
+        }
+        return string::npos;
+    }
+
+    // numbers, true, false, null
+    size_t i = pos;
+    while(i < end && data[i] != ',' && data[i] != '}' && data[i] != ']' && data[i] != ' ' && data[i] != '\n' && data[i] != '\r' && data[i] != '\t') i++;
+    return i == pos ? string::npos : i;
+}
+
+size_t LazySource::skipWhitespace(const string &text, size_t pos, size_t end){
+    while(pos < end && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) pos++;
+    return pos;
+}
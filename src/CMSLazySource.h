@@ -0,0 +1,104 @@
+//
+//  CMSLazySource.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSLazySource__
+#define __ofxCMS__CMSLazySource__
+
+#include "ofMain.h"
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include "ofxJSONElement.h"
+#include "CMSModel.h"
+
+namespace CMS {
+
+    // Attribute source for models that were parsed lazily (see Collection::setLazyParsing);
+    // such models only hold their eager attributes (ids and whatever attributes the collection
+    // needs for filtering and indexing), plus a reference to their record's bytes in the
+    // (retained) source json. The rest of the attributes are decoded on first access of
+    // any other attribute, after which the model is a regular model again.
+    //
+    // The source buffer is released when the last of its models is materialized (or released).
+    class LazySource : public AttributeSource{
+
+    public: // types
+
+        // byte range [begin, end) in a json text
+        class Slice {
+        public:
+            Slice() : begin(0), end(0){}
+            Slice(size_t b, size_t e) : begin(b), end(e){}
+            size_t begin, end;
+            size_t size() const { return end - begin; }
+        };
+
+        // member of a json object; the value is a byte range
+        class Member {
+        public:
+            string key;
+            Slice value;
+        };
+
+    public: // methods
+
+        // convert turns a json value into an attribute value (see Collection::parseModelJsonValue)
+        LazySource(std::function<string(Json::Value&)> convert) : mConvert(convert){}
+        ~LazySource();
+
+        // makes the model lazy; its record is the given range of the buffer and its eager
+        // attributes (which it should have already) are the given ones
+        void attach(Model *model, const std::shared_ptr<const string> &buffer, const Slice &record, const std::shared_ptr<const set<string> > &eagerAttrs);
+        // decodes the model's remaining attributes right away
+        void materialize(Model *model);
+        // forgets about the model, without decoding its remaining attributes
+        void release(Model *model);
+
+        bool has(Model *model){ return _entries.find(model) != _entries.end(); }
+        unsigned int pending(){ return _entries.size(); }
+
+        // decodes a single (member) value
+        string decode(const string &text, const Slice &value);
+
+    public: // AttributeSource methods
+
+        void access(Model *model, const string *attr);
+
+    public: // json scanning helpers; these find the boundaries of values without decoding them
+
+        // finds the elements of a json array; returns false if the text isn't a (well-formed) array
+        static bool splitArray(const string &text, vector<Slice> &elements);
+        // finds the members of a json object; returns false if it isn't a (well-formed) object
+        static bool splitObject(const string &text, const Slice &object, vector<Member> &members);
+        // position right after the value that starts at pos, or string::npos if it's invalid
+        static size_t skipValue(const string &text, size_t pos, size_t end);
+        static size_t skipWhitespace(const string &text, size_t pos, size_t end);
+
+    protected: // types
+
+        class Entry {
+        public:
+            std::shared_ptr<const string> buffer;
+            Slice record;
+            std::shared_ptr<const set<string> > eagerAttrs;
+        };
+
+    protected: // methods
+
+        void load(Model *model, Entry &entry);
+
+    protected: // attributes
+
+        std::function<string(Json::Value&)> mConvert;
+        std::unordered_map<Model*, Entry> _entries;
+
+    }; // class LazySource
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSLazySource__) */
@@ -0,0 +1,336 @@
+//
+//  CMSMemoryBudget.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSMemoryBudget__
+#define __ofxCMS__CMSMemoryBudget__
+
+#include "ofMain.h"
+#include <unordered_map>
+#include "CMSModel.h"
+#include "CMSIndex.h"
+
+namespace CMS {
+
+    // Keeps the (approximate) memory used by the attributes of a collection's models
+    // under a byte budget, by moving the attributes of the least-recently accessed models
+    // to a spill file. Spilled attributes are loaded back transparently when they are
+    // accessed (Model::get, Model::attributes, Model::set).
+    //
+    // Id attributes ("id" and "_id") and any other attributes marked as resident
+    // (see setResidentAttributes) always stay in memory, and accessing them doesn't
+    // load or touch anything, so id lookups don't thrash the budget.
+    //
+    // Models that already have another attribute source aren't managed; collections with
+    // a memory budget don't parse lazily for that reason.
+    //
+    // See Collection::setMemoryBudget
+    template<class ModelClass>
+    class MemoryBudget : public Index<ModelClass>, public AttributeSource{
+
+    public: // methods
+
+        MemoryBudget(size_t budget, const string &spillPath) : mBudget(budget), mResidentBytes(0), mSpillPath(spillPath),
+            mSpillEnd(0), mSpilledCount(0), mHits(0), mMisses(0), mEvictions(0){
+            _residentAttrs.insert("id");
+            _residentAttrs.insert("_id");
+            openSpillFile();
+        }
+
+        ~MemoryBudget(){
+            // whatever's still spilled at this point is lost
+            for(typename std::unordered_map<Model*, Entry>::iterator it = _entries.begin(); it != _entries.end(); it++){
+                it->first->setAttributeSource(NULL);
+            }
+
+            mSpill.close();
+            std::remove(mSpillPath.c_str());
+        }
+
+        void setBudget(size_t budget){
+            mBudget = budget;
+            enforce(NULL);
+        }
+
+        size_t getBudget(){ return mBudget; }
+
+        // attributes that are never spilled (in addition to the id attributes)
+        void setResidentAttributes(const vector<string> &attrs){
+            _residentAttrs.insert(attrs.begin(), attrs.end());
+        }
+
+        size_t residentBytes(){ return mResidentBytes; }
+        unsigned int spilledCount(){ return mSpilledCount; }
+
+        // counters; a hit is an access to a model that's in memory,
+        // a miss had to load the model's attributes from the spill file
+        unsigned int hits(){ return mHits; }
+        unsigned int misses(){ return mMisses; }
+        unsigned int evictions(){ return mEvictions; }
+        void resetCounters(){ mHits = mMisses = mEvictions = 0; }
+
+    public: // Index methods
+
+        void indexModel(ModelClass *model){
+            if(model->getAttributeSource() != NULL){
+                ofLogWarning() << "CMS::MemoryBudget - model (id=" << model->id() << ") already has an attribute source, not managing its memory";
+                return;
+            }
+
+            Entry &entry = _entries[model];
+            entry.spilled = false;
+            entry.bytes = measure(attributesOf(model));
+            _lru.push_front(model);
+            entry.lru = _lru.begin();
+            mResidentBytes += entry.bytes;
+
+            model->setAttributeSource(this);
+            enforce(model);
+        }
+
+        void unindexModel(ModelClass *model){
+            typename std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+            if(it == _entries.end()) return;
+
+            // models leaving the collection take all of their attributes with them
+            if(it->second.spilled) load(model, it->second);
+            // (load() made it the most recently used model)
+            _lru.erase(it->second.lru);
+
+            mResidentBytes -= it->second.bytes;
+            _entries.erase(it);
+            model->setAttributeSource(NULL);
+        }
+
+        void updateModel(ModelClass *model, const string &/* attr */, const string &/* value */, const string &/* old_value */){
+            typename std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+            if(it == _entries.end()) return;
+
+            // set() triggers access() before changing anything, so the model is loaded at this point
+            mResidentBytes -= it->second.bytes;
+            it->second.bytes = measure(attributesOf(model));
+            mResidentBytes += it->second.bytes;
+
+            enforce(model);
+        }
+
+    public: // AttributeSource methods
+
+        void access(Model *model, const string *attr){
+            typename std::unordered_map<Model*, Entry>::iterator it = _entries.find(model);
+            if(it == _entries.end()) return;
+
+            if(attr && _residentAttrs.find(*attr) != _residentAttrs.end()) return;
+
+            Entry &entry = it->second;
+
+            if(entry.spilled){
+                mMisses++;
+                load(model, entry);
+                // make room for what we just loaded, but keep the model we're accessing
+                enforce(model);
+                return;
+            }
+
+            mHits++;
+            // most recently used models are at the front
+            _lru.splice(_lru.begin(), _lru, entry.lru);
+        }
+
+    protected: // types
+
+        class Entry {
+        public:
+            Entry() : bytes(0), spilled(false), offset(0), capacity(0){}
+
+            typename list<Model*>::iterator lru;
+            size_t bytes;
+            bool spilled;
+            // location and size of the spill file slot holding the spilled attributes
+            streamoff offset;
+            size_t capacity;
+        };
+
+    protected: // methods
+
+        // rough estimate of the memory used by an attribute map
+        size_t measure(map<string, string> &attrs){
+            size_t bytes = 0;
+            for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+                bytes += it->first.capacity() + it->second.capacity() + sizeof(*it) + 4 * sizeof(void*) /* tree node */;
+            }
+            return bytes;
+        }
+
+        // spill least recently used models until we're within budget
+        void enforce(Model *keep){
+            // (already logged by openSpillFile)
+            if(!mSpill.is_open()) return;
+
+            while(mResidentBytes > mBudget && !_lru.empty()){
+                Model *model = _lru.back();
+                if(model == keep) break;
+                // no point in trying the others
+                if(!spill(model, _entries[model])) break;
+            }
+        }
+
+        // returns false (and leaves the model's attributes alone) when they couldn't be written
+        bool spill(Model *model, Entry &entry){
+            map<string, string> &attrs = attributesOf(model);
+
+            mRecord.clear();
+            unsigned int count = 0;
+            for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+                if(_residentAttrs.find(it->first) == _residentAttrs.end()) count++;
+            }
+
+            appendNumber(mRecord, count);
+            for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+                if(_residentAttrs.find(it->first) != _residentAttrs.end()) continue;
+                appendString(mRecord, it->first);
+                appendString(mRecord, it->second);
+            }
+
+            // re-use the smallest free slot that fits, or append to the file
+            std::multimap<size_t, streamoff>::iterator slot = _freeSlots.lower_bound(mRecord.size());
+            streamoff offset = slot == _freeSlots.end() ? mSpillEnd : slot->second;
+
+            mSpill.clear();
+            mSpill.seekp(offset);
+            mSpill.write(mRecord.data(), mRecord.size());
+            mSpill.flush();
+
+            if(!mSpill.good()){
+                ofLogError() << "CMS::MemoryBudget - couldn't write to spill file: " << mSpillPath << ", keeping model (id=" << model->id() << ") in memory";
+                return false;
+            }
+
+            entry.offset = offset;
+            if(slot == _freeSlots.end()){
+                entry.capacity = mRecord.size();
+                mSpillEnd += mRecord.size();
+            } else {
+                entry.capacity = slot->first;
+                _freeSlots.erase(slot);
+            }
+
+            // it's on disk; now it can go
+            for(map<string, string>::iterator it = attrs.begin(); it != attrs.end();){
+                if(_residentAttrs.find(it->first) == _residentAttrs.end())
+                    attrs.erase(it++);
+                else
+                    it++;
+            }
+
+            _lru.erase(entry.lru);
+            entry.spilled = true;
+            mResidentBytes -= entry.bytes;
+            entry.bytes = measure(attrs);
+            mResidentBytes += entry.bytes;
+            mSpilledCount++;
+            mEvictions++;
+            return true;
+        }
+
+        void load(Model *model, Entry &entry){
+            map<string, string> &attrs = attributesOf(model);
+
+            mSpill.clear();
+            mSpill.seekg(entry.offset);
+
+            unsigned int count = readNumber();
+            for(unsigned int i=0; i<count && mSpill.good(); i++){
+                string key = readString();
+                attrs[key] = readString();
+            }
+
+            if(!mSpill.good()){
+                ofLogError() << "CMS::MemoryBudget - couldn't read model (id=" << model->id() << ") from spill file: " << mSpillPath;
+            }
+
+            _lru.push_front(model);
+            entry.lru = _lru.begin();
+            entry.spilled = false;
+            mResidentBytes -= entry.bytes;
+            entry.bytes = measure(attrs);
+            mResidentBytes += entry.bytes;
+            mSpilledCount--;
+
+            if(mSpilledCount == 0){
+                // nothing left in the spill file that we need; start over
+                if(mSpillEnd > 0) openSpillFile();
+            } else if(entry.offset + (streamoff)entry.capacity == mSpillEnd){
+                mSpillEnd = entry.offset;
+            } else {
+                _freeSlots.insert(std::make_pair(entry.capacity, entry.offset));
+            }
+        }
+
+        void openSpillFile(){
+            if(mSpill.is_open()) mSpill.close();
+            mSpill.open(mSpillPath.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+            mSpillEnd = 0;
+            _freeSlots.clear();
+
+            if(!mSpill.is_open()){
+                ofLogError() << "CMS::MemoryBudget - couldn't open spill file: " << mSpillPath;
+            }
+        }
+
+        static void appendNumber(string &out, unsigned int number){
+            out.append((const char*)&number, sizeof(number));
+        }
+
+        unsigned int readNumber(){
+            unsigned int number = 0;
+            mSpill.read((char*)&number, sizeof(number));
+            return number;
+        }
+
+        static void appendString(string &out, const string &str){
+            appendNumber(out, str.size());
+            out.append(str);
+        }
+
+        string readString(){
+            unsigned int length = readNumber();
+            if(!mSpill.good()) return "";
+
+            string str(length, '\0');
+            if(length > 0) mSpill.read(&str[0], length);
+            return str;
+        }
+
+    protected: // attributes
+
+        size_t mBudget;
+        size_t mResidentBytes;
+        string mSpillPath;
+        fstream mSpill;
+        // end of the used part of the spill file
+        streamoff mSpillEnd;
+        // slots of loaded models, by size, to be re-used by the next spills
+        std::multimap<size_t, streamoff> _freeSlots;
+        // record being written
+        string mRecord;
+
+        std::unordered_map<Model*, Entry> _entries;
+        // resident models, most recently used first
+        list<Model*> _lru;
+        set<string> _residentAttrs;
+
+        unsigned int mSpilledCount;
+        unsigned int mHits;
+        unsigned int mMisses;
+        unsigned int mEvictions;
+
+    }; // class MemoryBudget
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSMemoryBudget__) */
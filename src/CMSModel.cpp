@@ -7,6 +7,8 @@
 //
 
 #include "CMSModel.h"
+#include "CMSEventQueue.h"
+#include "CMSTrace.h"
 #include "ofxJSONElement.h"
 
 #define INVALID_CID (-1)
@@ -15,29 +17,75 @@ using namespace CMS;
 
 int Model::mCidCounter = 0;
 
-Model::Model(){
+Model::Model() : mFingerprint(0), mAttributeSource(NULL), bDirtyTracking(false), _destroyedFlag(NULL){
     // TODO: use a more globally unique timestamp-based Cid format?
     mCid = "c"+ofToString(mCidCounter);
     mCidCounter++;
 }
 
-// Model::~Model(){
-//     ofNotifyEvent(beforeDestroyEvent, *this, this);
-// }
+Model::~Model(){
+    // queued notifications from or about us can't be delivered anymore
+    EventQueue::destroyed(this);
+    // let a set() call that's still notifying about us know
+    if(_destroyedFlag) *_destroyedFlag = true;
+}
 
 Model* Model::set(const string &attr, const string &value, bool notify){
+    if(mAttributeSource) mAttributeSource->access(this, NULL);
+
     string old_value = _attributes[attr];
 
     _attributes[attr] = value;
     onSetAttribute(attr, value);
 
     if(old_value != value){
-        static AttrChangeArgs args;
+        // we no longer match the record we were parsed from
+        mFingerprint = 0;
+
+        if(bDirtyTracking){
+            map<string, string>::iterator it = _committedValues.find(attr);
+            if(it == _committedValues.end())
+                _committedValues[attr] = old_value;
+            else if(it->second == value)
+                _committedValues.erase(it); // back to where we started
+        } else if(!_committedValues.empty()){
+            _committedValues.erase(attr);
+        }
+
+        // not static; listeners of the immediate event can change other models
+        AttrChangeArgs args;
         args.model = this;
         args.attr = attr;
         args.value = value;
+        args.old_value = old_value;
         onAttributeChanged(attr, value, old_value);
-        ofNotifyEvent(attributeChangedEvent, args, this);
+
+        // collections can remove (and destroy) us in response to the immediate event
+        // (for example when we no longer pass their active filters); ~Model sets this flag.
+        // The outer flag belongs to a set() call that's notifying further up the stack
+        bool destroyed = false;
+        bool *outerFlag = _destroyedFlag;
+        _destroyedFlag = &destroyed;
+
+        ofNotifyEvent(immediateAttributeChangedEvent, args, this);
+
+        if(!destroyed){
+            EventQueue *queue = EventQueue::deferring();
+            if(queue){
+                queue->postChange(attributeChangedEvent, args, this);
+            } else {
+                // calls made by our listeners are application calls (see TraceRecorder)
+                TraceRecorder::Listeners listeners(TraceRecorder::active());
+                ofNotifyEvent(attributeChangedEvent, args, this);
+            }
+        }
+
+        if(destroyed){
+            if(outerFlag) *outerFlag = true;
+            return NULL;
+        }
+
+        _destroyedFlag = outerFlag;
     }
 
     // returning `this` allows the caller to link operations, like so:
@@ -48,25 +96,63 @@ Model* Model::set(const string &attr, const string &value, bool notify){
 
 Model* Model::set(map<string, string> &attrs){
     for(map<string, string>::iterator it=attrs.begin(); it != attrs.end(); it++){
-        this->set(it->first, it->second);
+        if(!this->set(it->first, it->second))
+            return NULL; // destroyed
     }
 
 	return this;
 }
 
-string Model::get(const string &attr, string _default){
-    return (_attributes.find(attr) == _attributes.end()) ? _default : _attributes[attr];
+string Model::get(const string &attr, const string &_default){
+    const string *value = lookup(attr);
+    return value ? *value : _default;
+}
+
+const string* Model::lookup(const string &attr){
+    if(mAttributeSource) mAttributeSource->access(this, &attr);
+    // single (const) lookup; this gets called concurrently by parallel collection scans
+    map<string, string>::const_iterator it = _attributes.find(attr);
+    return it == _attributes.end() ? NULL : &it->second;
+}
+
+bool Model::attrEquals(const string &attr, const string &value){
+    const string *current = lookup(attr);
+    return current ? *current == value : value.empty();
 }
 
-string Model::cid(){
+const string &Model::cid(){
     return mCid;
 }
 
-string Model::id(){
+const string &Model::id(){
+    static const string ID_ATTR = "id";
+    static const string MONGO_ID_ATTR = "_id";
+
     // look for an "id" attribute, if that's not present,
     // look for an "_id" attribute (mongoDB style), if that's not present,
     // grab the cid()
-    return get("id", get("_id", cid()));
+    const string *value = lookup(ID_ATTR);
+    if(value == NULL) value = lookup(MONGO_ID_ATTR);
+    return value ? *value : mCid;
+}
+
+map<string, string> Model::changedAttributes(){
+    map<string, string> changed;
+    for(map<string, string>::iterator it = _committedValues.begin(); it != _committedValues.end(); it++){
+        changed[it->first] = get(it->first);
+    }
+    return changed;
+}
+
+map<string, string> &AttributeSource::attributesOf(Model *model){
+    return model->_attributes;
+}
+
+void AttributeSource::loadAttribute(Model *model, const string &attr, const string &value){
+    model->_attributes[attr] = value;
+    model->onSetAttribute(attr, value);
+    // as far as the model is concerned, it was empty until now (like in set())
+    if(!value.empty()) model->onAttributeChanged(attr, value, "");
 }
 
 //// this was causing SIGABRT exceptions...
@@ -75,6 +161,15 @@ void Model::destroy(bool notify){
    // delete this; // this is causing issues (on windows) and one might consider "delete this" a bad paradigm...
 }
 
+unsigned long long Model::fingerprint(const char *data, unsigned int length, unsigned long long seed){
+    unsigned long long hash = seed;
+    for(unsigned int i=0; i<length; i++){
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 // Convenience method with built-in support for MongoDB-style id format
 vector<string> Model::jsonArrayToIdsVector(string jsonText){
     return jsonArrayToStringVector(jsonText);
@@ -21,6 +21,24 @@ namespace CMS {
         Model *model;
         string attr;
         string value;
+        string old_value;
+    };
+
+    // Optional hook that is consulted right before a model's attributes are accessed,
+    // which allows for attributes that (temporarily) live somewhere else than in the
+    // model's attribute map (see MemoryBudget)
+    class AttributeSource {
+    public:
+        virtual ~AttributeSource(){}
+        // attr is the requested attribute, or NULL when all attributes are accessed (attributes(), set())
+        virtual void access(Model *model, const string *attr) = 0;
+
+    protected:
+        // direct access to a model's attribute map, without triggering access()
+        map<string, string> &attributesOf(Model *model);
+        // sets an attribute that was there all along, but wasn't loaded yet; no access(),
+        // no events, but it does call the model's onSetAttribute and onAttributeChanged callbacks
+        void loadAttribute(Model *model, const string &attr, const string &value);
     };
     
     // a key-value pair model that fires notifications when attributes change,
@@ -29,14 +47,53 @@ namespace CMS {
 
     public:
         Model();
-        // ~Model();
+        virtual ~Model();
 
+        // both return NULL when the model got destroyed in response to the change
+        // (by a collection that destroys the models it removes)
         Model* set(const string &attr, const string &value, bool notify = true);
         Model* set(map<string, string> &attrs);
-        string get(const string &attr, string _default = "");
-        string id();
-        string cid();
-        map<string, string> &attributes(){ return _attributes; }
+        string get(const string &attr, const string &_default = "");
+        // non-copying accessors; lookup returns NULL when the attribute doesn't exist,
+        // attrEquals treats a missing attribute as an empty value (like get() does).
+        // lookup's pointer is only valid until the attribute changes; with a MemoryBudget, also only
+        // until the next access of another model's attributes (which can spill this model)
+        const string* lookup(const string &attr);
+        bool attrEquals(const string &attr, const string &value);
+        // these return references into the model; they're only valid until the id/_id attributes change
+        const string &id();
+        const string &cid();
+        map<string, string> &attributes(){
+            if(mAttributeSource) mAttributeSource->access(this, NULL);
+            return _attributes;
+        }
+
+        void setAttributeSource(AttributeSource *source){ mAttributeSource = source; }
+        AttributeSource* getAttributeSource(){ return mAttributeSource; }
+
+        // content fingerprint of the record this model was last parsed from (0 if unknown);
+        // used by Collection::parse to skip records that didn't change.
+        // Any attribute change resets the fingerprint
+        unsigned long long fingerprint(){ return mFingerprint; }
+        void setFingerprint(unsigned long long fingerprint){ mFingerprint = fingerprint; }
+        // false while the fingerprint is unknown, even if the given fingerprint happens to be 0
+        bool matchesFingerprint(unsigned long long fingerprint){ return mFingerprint != 0 && mFingerprint == fingerprint; }
+
+        // dirty tracking; keeps track of which attributes changed since the last commit().
+        // Setting an attribute back to its committed value makes it clean again.
+        // Disabled by default; collections enable it for their models when change tracking is
+        // enabled (see Collection::setChangeTracking). While tracking is disabled (Collection
+        // also does this while parsing), changed attributes are considered to be in sync with
+        // their source and are no longer dirty
+        bool isDirty(){ return !_committedValues.empty(); }
+        bool isDirty(const string &attr){ return _committedValues.find(attr) != _committedValues.end(); }
+        // dirty attributes, with the value they had at the last commit()
+        const map<string, string> &dirtyAttributes(){ return _committedValues; }
+        // dirty attributes, with their current value
+        map<string, string> changedAttributes();
+        void commit(){ _committedValues.clear(); }
+        void setDirtyTracking(bool enable){ bDirtyTracking = enable; }
+        bool getDirtyTracking(){ return bDirtyTracking; }
 
         void destroy(bool notify = true);
 
@@ -45,9 +102,16 @@ namespace CMS {
         static vector<string> jsonArrayToIdsVector(string jsonText);
         static vector<string> jsonArrayToStringVector(string jsonText);
 
+        // 64-bit FNV-1a hash, can be chained by passing in the result of a previous call as seed
+        static unsigned long long fingerprint(const char *data, unsigned int length, unsigned long long seed = FINGERPRINT_SEED);
+        static const unsigned long long FINGERPRINT_SEED = 14695981039346656037ull;
+
     public: // events
 
         ofEvent <AttrChangeArgs> attributeChangedEvent;
+        // same as attributeChangedEvent, but never deferred (see EventQueue); this is what
+        // collections use to keep up with their models
+        ofEvent <AttrChangeArgs> immediateAttributeChangedEvent;
         ofEvent <Model> beforeDestroyEvent;
 
     protected: // callbacks
@@ -58,6 +122,14 @@ namespace CMS {
     protected:
 
         map<string, string> _attributes;
+        unsigned long long mFingerprint;
+        AttributeSource *mAttributeSource;
+        // committed values of dirty attributes
+        map<string, string> _committedValues;
+        bool bDirtyTracking;
+        // points at a flag of the set() call that's notifying about us, if any
+        bool *_destroyedFlag;
+        friend class AttributeSource;
 
         // CID stuff (client-id, local/internal ids,
         // mainly to identify unpersisted models)
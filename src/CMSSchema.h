@@ -0,0 +1,185 @@
+//
+//  CMSSchema.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSSchema__
+#define __ofxCMS__CMSSchema__
+
+#include "ofMain.h"
+#include <tuple>
+#include <cstdlib>
+#include "CMSModel.h"
+
+namespace CMS {
+
+    // string conversions of typed field values
+    template<typename T>
+    class FieldTraits;
+
+    template<>
+    class FieldTraits<string>{
+    public:
+        static string fromString(const string &value){ return value; }
+        static string toString(const string &value){ return value; }
+    };
+
+    template<>
+    class FieldTraits<int>{
+    public:
+        static int fromString(const string &value){ return ofToInt(value); }
+        static string toString(int value){ return ofToString(value); }
+    };
+
+    template<>
+    class FieldTraits<long long>{
+    public:
+        static long long fromString(const string &value){ return strtoll(value.c_str(), NULL, 10); }
+        static string toString(long long value){ return ofToString(value); }
+    };
+
+    template<>
+    class FieldTraits<float>{
+    public:
+        static float fromString(const string &value){ return ofToFloat(value); }
+        static string toString(float value){
+            // shortest representation that reads back as the same value
+            char str[32];
+            snprintf(str, sizeof(str), "%.7g", value);
+            if(strtof(str, NULL) != value) snprintf(str, sizeof(str), "%.9g", value);
+            return str;
+        }
+    };
+
+    template<>
+    class FieldTraits<double>{
+    public:
+        static double fromString(const string &value){ return strtod(value.c_str(), NULL); }
+        static string toString(double value){
+            // shortest representation that reads back as the same value
+            char str[32];
+            snprintf(str, sizeof(str), "%.15g", value);
+            if(strtod(str, NULL) != value) snprintf(str, sizeof(str), "%.17g", value);
+            return str;
+        }
+    };
+
+    template<>
+    class FieldTraits<bool>{
+    public:
+        static bool fromString(const string &value){ return value == "true" || value == "1"; }
+        static string toString(bool value){ return value ? "true" : "false"; }
+    };
+
+    // base class for field declarations; see CMS_FIELD
+    template<typename T>
+    class Field{
+    public:
+        typedef T type;
+    };
+
+    // declares a typed field, for example: CMS_FIELD(Year, "year", int);
+    #define CMS_FIELD(NAME, KEY, TYPE) \
+        class NAME : public CMS::Field<TYPE>{ public: static const char* key(){ return KEY; } }
+
+    // position of field F in Fields...; doesn't compile when F isn't one of them
+    template<class F, class... Fields>
+    class FieldIndex;
+
+    template<class F, class... Rest>
+    class FieldIndex<F, F, Rest...>{
+    public:
+        static const unsigned int value = 0;
+    };
+
+    template<class F, class G, class... Rest>
+    class FieldIndex<F, G, Rest...>{
+    public:
+        static const unsigned int value = 1 + FieldIndex<F, Rest...>::value;
+    };
+
+    // Model with a compile-time schema; every declared field gets a typed slot in the model,
+    // which is kept in sync with the (string) attribute of the same name. Typed reads
+    // (get<Field>()) don't do any lookups or string conversions, while everything else
+    // (events, collections, indexes, parsing) keeps working with the string attributes.
+    // Undeclared attributes are just regular string attributes.
+    //
+    // Slots are updated in onSetAttribute; subclasses that override it should call
+    // SchemaModel::onSetAttribute, and attributes modified through attributes() directly
+    // don't update their slots.
+    //
+    // Usage:
+    //
+    //  CMS_FIELD(Title, "title", string);
+    //  CMS_FIELD(Year, "year", int);
+    //
+    //  class Record : public CMS::SchemaModel<Title, Year> {};
+    //
+    //  record->get<Year>(); // int
+    //  record->set<Year>(2014); // sets the "year" attribute to "2014"
+    //  collection.filterBy<Year>(2014);
+    //
+    template<class... Fields>
+    class SchemaModel : public Model{
+
+    public: // methods
+
+        using Model::get;
+        using Model::set;
+
+        template<class F>
+        const typename F::type &get(){
+            // attributes might not be loaded yet (see Collection::setLazyParsing)
+            if(mAttributeSource) mAttributeSource->access(this, &fieldName<F>());
+            return std::get<FieldIndex<F, Fields...>::value>(mSlots);
+        }
+
+        template<class F>
+        SchemaModel* set(const typename F::type &value){
+            // NULL when the model got destroyed in response
+            return Model::set(fieldName<F>(), FieldTraits<typename F::type>::toString(value)) ? this : NULL;
+        }
+
+        // the attribute name of a field, as a string
+        template<class F>
+        static const string &fieldName(){
+            static const string name(F::key());
+            return name;
+        }
+
+        static unsigned int fieldCount(){ return sizeof...(Fields); }
+
+    protected: // callbacks
+
+        virtual void onSetAttribute(const string &attr, const string &value){
+            assignSlot<0, Fields...>(attr, value);
+        }
+
+    protected: // methods
+
+        template<unsigned int I, class F, class... Rest>
+        void assignSlot(const string &attr, const string &value){
+            if(attr == fieldName<F>()){
+                std::get<I>(mSlots) = FieldTraits<typename F::type>::fromString(value);
+                return;
+            }
+
+            assignSlot<I+1, Rest...>(attr, value);
+        }
+
+        // not a declared field
+        template<unsigned int I>
+        void assignSlot(const string &attr, const string &value){}
+
+    protected: // attributes
+
+        std::tuple<typename Fields::type...> mSlots;
+
+    }; // class SchemaModel
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSSchema__) */
@@ -0,0 +1,198 @@
+//
+//  CMSSearchIndex.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSSearchIndex__
+#define __ofxCMS__CMSSearchIndex__
+
+#include "ofMain.h"
+#include <unordered_map>
+#include "CMSIndex.h"
+
+namespace CMS {
+
+    // Inverted index (token -> models) over a set of attributes, kept up-to-date
+    // by the collection it's attached to (see Collection::searchIndex).
+    //
+    // Every term in a query is prefix-matched (so results update while typing)
+    // and all terms have to match (AND). Results are ranked by the number of
+    // matching tokens, where exact token matches weigh more than prefix matches.
+    template<class ModelClass>
+    class SearchIndex : public Index<ModelClass>{
+
+    public: // methods
+
+        SearchIndex(const vector<string> &attrs) : _attrs(attrs), mOrderCounter(0){}
+
+        const vector<string> &attrs(){ return _attrs; }
+
+        // returns matching models, best match first; limit 0 means no limit
+        vector<ModelClass*> search(const string &query, unsigned int limit = 0){
+            vector<ModelClass*> result;
+            vector<string> terms = tokenize(query);
+            if(terms.empty()) return result;
+
+            // the longest term is probably the most selective one, start with that
+            // so the AND below only has to check a small number of candidates
+            std::sort(terms.begin(), terms.end(), &SearchIndex<ModelClass>::longerFirst);
+
+            ScoreMap scores;
+            termScores(terms[0], scores, NULL);
+
+            // AND; only keep models that match every term
+            for(int i=1; i<terms.size() && !scores.empty(); i++){
+                ScoreMap other;
+                termScores(terms[i], other, &scores);
+
+                for(typename ScoreMap::iterator it = scores.begin(); it != scores.end();){
+                    typename ScoreMap::iterator match = other.find(it->first);
+                    if(match == other.end()){
+                        it = scores.erase(it);
+                    } else {
+                        it->second += match->second;
+                        it++;
+                    }
+                }
+            }
+
+            vector<Ranked> ranked;
+            ranked.reserve(scores.size());
+            for(typename ScoreMap::iterator it = scores.begin(); it != scores.end(); it++){
+                Ranked r = {it->second, _order[it->first], it->first};
+                ranked.push_back(r);
+            }
+
+            unsigned int count = (limit == 0 || limit > ranked.size()) ? ranked.size() : limit;
+            std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), &SearchIndex<ModelClass>::rankedFirst);
+
+            result.reserve(count);
+            for(int i=0; i<count; i++){
+                result.push_back(ranked[i].model);
+            }
+
+            return result;
+        }
+
+        // number of distinct tokens in the index
+        unsigned int size(){ return _postings.size(); }
+
+        // lower-cased alphanumeric words; bytes outside the ASCII range (UTF-8) are kept as part of words
+        static vector<string> tokenize(const string &text){
+            vector<string> tokens;
+            string token;
+
+            for(int i=0; i<text.size(); i++){
+                unsigned char c = text[i];
+
+                if(isalnum(c) || c >= 0x80){
+                    token += (char)tolower(c);
+                } else if(!token.empty()){
+                    tokens.push_back(token);
+                    token.clear();
+                }
+            }
+
+            if(!token.empty()) tokens.push_back(token);
+            return tokens;
+        }
+
+    public: // Index methods
+
+        void indexModel(ModelClass *model){
+            _order[model] = mOrderCounter++;
+
+            for(int i=0; i<_attrs.size(); i++){
+                const string *value = model->lookup(_attrs[i]);
+                if(value) addTokens(model, *value);
+            }
+        }
+
+        void unindexModel(ModelClass *model){
+            for(int i=0; i<_attrs.size(); i++){
+                const string *value = model->lookup(_attrs[i]);
+                if(value) removeTokens(model, *value);
+            }
+
+            _order.erase(model);
+        }
+
+        void updateModel(ModelClass *model, const string &attr, const string &value, const string &old_value){
+            if(std::find(_attrs.begin(), _attrs.end(), attr) == _attrs.end()) return;
+            removeTokens(model, old_value);
+            addTokens(model, value);
+        }
+
+    protected: // methods
+
+        void addTokens(ModelClass *model, const string &text){
+            vector<string> tokens = tokenize(text);
+            for(int i=0; i<tokens.size(); i++){
+                _postings[tokens[i]][model]++;
+            }
+        }
+
+        void removeTokens(ModelClass *model, const string &text){
+            vector<string> tokens = tokenize(text);
+
+            for(int i=0; i<tokens.size(); i++){
+                typename map<string, map<ModelClass*, int> >::iterator it = _postings.find(tokens[i]);
+                if(it == _postings.end()) continue;
+
+                typename map<ModelClass*, int>::iterator posting = it->second.find(model);
+                if(posting == it->second.end()) continue;
+
+                if(--posting->second <= 0) it->second.erase(posting);
+                if(it->second.empty()) _postings.erase(it);
+            }
+        }
+
+        typedef std::unordered_map<ModelClass*, float> ScoreMap;
+
+        // scores of all models with a token that starts with the given term,
+        // optionally only for the given candidates
+        void termScores(const string &term, ScoreMap &scores, ScoreMap *candidates){
+            // tokens are sorted, so all tokens with this prefix are right after lower_bound(term)
+            for(typename map<string, map<ModelClass*, int> >::iterator it = _postings.lower_bound(term); it != _postings.end(); it++){
+                if(it->first.compare(0, term.size(), term) != 0) break;
+
+                float weight = it->first.size() == term.size() ? 2.0f : 1.0f;
+                for(typename map<ModelClass*, int>::iterator posting = it->second.begin(); posting != it->second.end(); posting++){
+                    if(candidates && candidates->find(posting->first) == candidates->end()) continue;
+                    scores[posting->first] += weight * posting->second;
+                }
+            }
+        }
+
+        struct Ranked {
+            float score;
+            unsigned int order;
+            ModelClass *model;
+        };
+
+        // highest score first, order of indexing for equal scores
+        static bool rankedFirst(const Ranked &a, const Ranked &b){
+            return a.score != b.score ? a.score > b.score : a.order < b.order;
+        }
+
+        static bool longerFirst(const string &a, const string &b){
+            return a.size() > b.size();
+        }
+
+    protected: // attributes
+
+        vector<string> _attrs;
+        // token -> model -> number of occurrences
+        map<string, map<ModelClass*, int> > _postings;
+        // to give equally ranked results a stable order
+        std::unordered_map<ModelClass*, unsigned int> _order;
+        unsigned int mOrderCounter;
+
+    }; // class SearchIndex
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSSearchIndex__) */
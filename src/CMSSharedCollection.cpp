@@ -0,0 +1,402 @@
+//
+//  CMSSharedCollection.cpp
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#include "CMSSharedCollection.h"
+
+#ifndef TARGET_WIN32
+
+#include <unordered_map>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace CMS;
+using namespace CMS::SharedLayout;
+
+static string controlName(const string &name){
+    return "/" + name;
+}
+
+static string segmentName(const string &name, uint32_t generation){
+    return "/" + name + "." + ofToString(generation);
+}
+
+// maps a data segment read-only and verifies it's a complete segment of the given generation
+static const char* mapSegment(const string &name, uint32_t generation, size_t &size){
+    int fd = shm_open(segmentName(name, generation).c_str(), O_RDONLY, 0);
+    if(fd == -1) return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)){
+        ::close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) return NULL;
+
+    const Header *header = (const Header*)data;
+    if(header->magic != MAGIC || header->version != VERSION || header->generation != generation || header->size != st.st_size){
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    size = st.st_size;
+    return (const char*)data;
+}
+
+//
+// SharedModel
+//
+
+const char* SharedModel::lookup(const string &attr) const {
+    return _collection ? _collection->lookup(mIndex, attr.c_str()) : NULL;
+}
+
+bool SharedModel::attrEquals(const string &attr, const string &value) const {
+    const char *current = lookup(attr);
+    return current ? value == current : value.empty();
+}
+
+string SharedModel::id() const {
+    return _collection ? _collection->str(_collection->modelEntry(mIndex)->id) : "";
+}
+
+map<string, string> SharedModel::attributes() const {
+    map<string, string> attrs;
+    if(_collection == NULL) return attrs;
+
+    const ModelEntry *model = _collection->modelEntry(mIndex);
+    for(uint32_t i=0; i<model->attrCount; i++){
+        const AttrEntry *attr = _collection->attrEntry(model->firstAttr + i);
+        attrs[_collection->str(attr->key)] = _collection->str(attr->value);
+    }
+
+    return attrs;
+}
+
+//
+// SharedCollection
+//
+
+bool SharedCollection::open(const string &name){
+    close();
+    mName = name;
+
+    int fd = shm_open(controlName(name).c_str(), O_RDONLY, 0);
+    if(fd == -1){
+        ofLogWarning() << "CMS::SharedCollection::open() - no shared collection named: " << name;
+        return false;
+    }
+
+    void *control = mmap(NULL, sizeof(Control), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if(control == MAP_FAILED || ((Control*)control)->magic != MAGIC || ((Control*)control)->version != VERSION){
+        ofLogWarning() << "CMS::SharedCollection::open() - invalid shared collection: " << name;
+        if(control != MAP_FAILED) munmap(control, sizeof(Control));
+        return false;
+    }
+
+    _control = (const Control*)control;
+
+    // the publisher might be swapping generations right now; try again if we miss one
+    for(int attempt=0; attempt<3; attempt++){
+        if(update()) return true;
+    }
+
+    ofLogWarning() << "CMS::SharedCollection::open() - couldn't map shared collection: " << name;
+    return false;
+}
+
+void SharedCollection::close(){
+    unmapData();
+
+    if(_control){
+        munmap((void*)_control, sizeof(Control));
+        _control = NULL;
+    }
+}
+
+bool SharedCollection::update(){
+    if(_control == NULL) return false;
+
+    uint32_t generation = __atomic_load_n(&_control->generation, __ATOMIC_ACQUIRE);
+    if(generation == 0 || (_data && generation == header()->generation)) return false;
+
+    return mapGeneration(generation);
+}
+
+bool SharedCollection::mapGeneration(uint32_t generation){
+    size_t size = 0;
+    const char *data = mapSegment(mName, generation, size);
+    if(data == NULL) return false;
+
+    unmapData();
+    _data = data;
+    mSize = size;
+    return true;
+}
+
+void SharedCollection::unmapData(){
+    if(_data == NULL) return;
+    munmap((void*)_data, mSize);
+    _data = NULL;
+    mSize = 0;
+}
+
+SharedModel SharedCollection::at(unsigned int idx) const {
+    if(idx >= count()){
+        ofLogWarning() << "CMS::SharedCollection::at(unsigned int) - got invalid index";
+        return SharedModel();
+    }
+
+    return SharedModel(this, idx);
+}
+
+vector<SharedModel> SharedCollection::models() const {
+    vector<SharedModel> models;
+    models.reserve(count());
+
+    for(uint32_t i=0; i<count(); i++){
+        models.push_back(SharedModel(this, i));
+    }
+
+    return models;
+}
+
+SharedModel SharedCollection::previous(const SharedModel &model) const {
+    int idx = index(model);
+    if(idx == INVALID_INDEX) return SharedModel();
+    return at(idx == 0 ? count() - 1 : idx - 1);
+}
+
+SharedModel SharedCollection::next(const SharedModel &model) const {
+    int idx = index(model);
+    if(idx == INVALID_INDEX) return SharedModel();
+    return at((idx + 1) % count());
+}
+
+SharedModel SharedCollection::findById(const string &_id) const {
+    if(_data == NULL) return SharedModel();
+
+    // binary search the (sorted) id index
+    const uint32_t *ids = (const uint32_t*)(_data + header()->idIndexOffset);
+    int low = 0, high = (int)count() - 1;
+
+    while(low <= high){
+        int mid = (low + high) / 2;
+        int cmp = strcmp(str(modelEntry(ids[mid])->id), _id.c_str());
+        if(cmp == 0) return SharedModel(this, ids[mid]);
+        if(cmp < 0) low = mid + 1; else high = mid - 1;
+    }
+
+    return SharedModel();
+}
+
+SharedModel SharedCollection::findByAttr(const string &attr, const string &value) const {
+    for(uint32_t i=0; i<count(); i++){
+        const char *current = lookup(i, attr.c_str());
+        if(current && value == current) return SharedModel(this, i);
+    }
+
+    return SharedModel();
+}
+
+vector<SharedModel> SharedCollection::filterBy(const string &attr, const string &value) const {
+    vector<SharedModel> models;
+
+    for(uint32_t i=0; i<count(); i++){
+        const char *current = lookup(i, attr.c_str());
+        if(current ? value == current : value.empty()) models.push_back(SharedModel(this, i));
+    }
+
+    return models;
+}
+
+const char* SharedCollection::lookup(uint32_t index, const char *attr) const {
+    const ModelEntry *model = modelEntry(index);
+
+    // binary search the model's (sorted) attributes
+    int low = 0, high = (int)model->attrCount - 1;
+    while(low <= high){
+        int mid = (low + high) / 2;
+        const AttrEntry *entry = attrEntry(model->firstAttr + mid);
+        int cmp = strcmp(str(entry->key), attr);
+        if(cmp == 0) return str(entry->value);
+        if(cmp < 0) low = mid + 1; else high = mid - 1;
+    }
+
+    return NULL;
+}
+
+//
+// SharedCollectionPublisher
+//
+
+SharedCollectionPublisher::SharedCollectionPublisher(const string &name) : mName(name), _control(NULL), mGeneration(0){
+    int fd = shm_open(controlName(name).c_str(), O_CREAT | O_RDWR, 0644);
+    if(fd == -1 || ftruncate(fd, sizeof(Control)) != 0){
+        ofLogError() << "CMS::SharedCollectionPublisher - couldn't create shared memory: " << controlName(name);
+        if(fd != -1) ::close(fd);
+        return;
+    }
+
+    void *control = mmap(NULL, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if(control == MAP_FAILED){
+        ofLogError() << "CMS::SharedCollectionPublisher - couldn't map shared memory: " << controlName(name);
+        return;
+    }
+
+    _control = (Control*)control;
+
+    // continue where a previous publisher left off, so readers don't mistake a new generation for an old one
+    if(_control->magic == MAGIC && _control->version == VERSION){
+        mGeneration = _control->generation;
+    } else {
+        _control->magic = MAGIC;
+        _control->version = VERSION;
+        __atomic_store_n(&_control->generation, 0, __ATOMIC_RELEASE);
+    }
+}
+
+SharedCollectionPublisher::~SharedCollectionPublisher(){
+    if(mGeneration > 0) unlinkGeneration(mGeneration);
+    if(mGeneration > 1) unlinkGeneration(mGeneration-1);
+
+    if(_control){
+        munmap(_control, sizeof(Control));
+        shm_unlink(controlName(mName).c_str());
+    }
+}
+
+bool SharedCollectionPublisher::publishModels(const vector<Model*> &models){
+    if(_control == NULL) return false;
+
+    // intern all strings (ids, keys and values)
+    std::unordered_map<string, uint32_t> indices;
+    vector<const string*> strings;
+    size_t stringBytes = 0;
+    vector<uint32_t> modelIds(models.size());
+    uint32_t attrCount = 0;
+
+    for(size_t i=0; i<models.size(); i++){
+        const string &_id = models[i]->id();
+        std::pair<std::unordered_map<string, uint32_t>::iterator, bool> result = indices.insert(std::make_pair(_id, (uint32_t)strings.size()));
+        if(result.second){
+            strings.push_back(&result.first->first);
+            stringBytes += _id.size() + 1;
+        }
+        modelIds[i] = result.first->second;
+
+        map<string, string> &attrs = models[i]->attributes();
+        for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+            for(int j=0; j<2; j++){
+                const string &value = j == 0 ? it->first : it->second;
+                result = indices.insert(std::make_pair(value, (uint32_t)strings.size()));
+                if(result.second){
+                    strings.push_back(&result.first->first);
+                    stringBytes += value.size() + 1;
+                }
+            }
+        }
+
+        attrCount += attrs.size();
+    }
+
+    // layout; every section is a multiple of 4 bytes
+    Header header;
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.generation = mGeneration + 1;
+    header.modelCount = models.size();
+    header.stringCount = strings.size();
+    header.modelsOffset = sizeof(Header);
+    header.attrsOffset = header.modelsOffset + models.size() * sizeof(ModelEntry);
+    header.idIndexOffset = header.attrsOffset + attrCount * sizeof(AttrEntry);
+    header.stringsOffset = header.idIndexOffset + models.size() * sizeof(uint32_t);
+    header.size = header.stringsOffset + strings.size() * sizeof(uint32_t) + stringBytes;
+
+    string segment = segmentName(mName, header.generation);
+    int fd = shm_open(segment.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd == -1 || ftruncate(fd, header.size) != 0){
+        ofLogError() << "CMS::SharedCollectionPublisher::publish() - couldn't create shared memory: " << segment;
+        if(fd != -1){
+            ::close(fd);
+            shm_unlink(segment.c_str());
+        }
+        return false;
+    }
+
+    char *data = (char*)mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if(data == MAP_FAILED){
+        ofLogError() << "CMS::SharedCollectionPublisher::publish() - couldn't map shared memory: " << segment;
+        shm_unlink(segment.c_str());
+        return false;
+    }
+
+    memcpy(data, &header, sizeof(Header));
+
+    // models and their attributes (std::map already sorts them by key)
+    ModelEntry *modelEntries = (ModelEntry*)(data + header.modelsOffset);
+    AttrEntry *attrEntries = (AttrEntry*)(data + header.attrsOffset);
+    uint32_t attrIndex = 0;
+
+    for(size_t i=0; i<models.size(); i++){
+        map<string, string> &attrs = models[i]->attributes();
+        modelEntries[i].id = modelIds[i];
+        modelEntries[i].firstAttr = attrIndex;
+        modelEntries[i].attrCount = attrs.size();
+
+        for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+            attrEntries[attrIndex].key = indices[it->first];
+            attrEntries[attrIndex].value = indices[it->second];
+            attrIndex++;
+        }
+    }
+
+    // id index, sorted by id
+    uint32_t *idIndex = (uint32_t*)(data + header.idIndexOffset);
+    for(uint32_t i=0; i<header.modelCount; i++) idIndex[i] = i;
+    std::sort(idIndex, idIndex + header.modelCount, [&](uint32_t a, uint32_t b){
+        return strcmp(strings[modelIds[a]]->c_str(), strings[modelIds[b]]->c_str()) < 0;
+    });
+
+    // string table
+    uint32_t *offsets = (uint32_t*)(data + header.stringsOffset);
+    char *stringData = (char*)(offsets + strings.size());
+    uint32_t offset = 0;
+    for(size_t i=0; i<strings.size(); i++){
+        offsets[i] = offset;
+        memcpy(stringData + offset, strings[i]->c_str(), strings[i]->size() + 1);
+        offset += strings[i]->size() + 1;
+    }
+
+    munmap(data, header.size);
+
+    // swap; readers pick up the new generation on their next update()
+    mGeneration = header.generation;
+    __atomic_store_n(&_control->generation, mGeneration, __ATOMIC_RELEASE);
+
+    // keep the previous generation for readers that are swapping right now
+    if(mGeneration > 2) unlinkGeneration(mGeneration-2);
+    return true;
+}
+
+void SharedCollectionPublisher::unlinkGeneration(uint32_t generation){
+    shm_unlink(segmentName(mName, generation).c_str());
+}
+
+#endif // TARGET_WIN32
@@ -0,0 +1,257 @@
+//
+//  CMSSharedCollection.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSSharedCollection__
+#define __ofxCMS__CMSSharedCollection__
+
+#include "ofMain.h"
+
+// POSIX shared memory; not available on windows
+#ifndef TARGET_WIN32
+
+#include <stdint.h>
+#include "CMSModel.h"
+
+namespace CMS {
+
+    class SharedCollection;
+
+    // Shared memory layout (all offsets are in bytes from the start of the segment,
+    // all strings are indices into the segment's (interned) string table)
+    namespace SharedLayout {
+        const uint32_t MAGIC = 0x534d4f43; // "COMS"
+        const uint32_t VERSION = 1;
+
+        // the control segment; tells readers which generation is the current one
+        class Control {
+        public:
+            uint32_t magic;
+            uint32_t version;
+            volatile uint32_t generation;
+        };
+
+        class Header {
+        public:
+            uint32_t magic;
+            uint32_t version;
+            uint32_t generation;
+            uint32_t size;
+            uint32_t modelCount;
+            uint32_t stringCount;
+            // offsets of the model, attribute, id index and string table sections
+            uint32_t modelsOffset;
+            uint32_t attrsOffset;
+            uint32_t idIndexOffset;
+            uint32_t stringsOffset;
+        };
+
+        class ModelEntry {
+        public:
+            uint32_t id;
+            uint32_t firstAttr;
+            uint32_t attrCount;
+        };
+
+        // a model's attributes are sorted by key
+        class AttrEntry {
+        public:
+            uint32_t key;
+            uint32_t value;
+        };
+
+        // the string table holds an offset per string (relative to the string table)
+        // followed by the null-terminated string data
+    };
+
+    // Read-only view of a model in a SharedCollection; only valid until the collection
+    // swaps to another generation (SharedCollection::update) or gets closed.
+    //
+    // This is not a Model (there's no attribute map to hand out and nothing to notify),
+    // but it offers Model's read-only accessors under the same names. Together with
+    // operator-> and the conversion to bool, code like
+    //
+    //  if(record) ofLog() << record->get("title");
+    //
+    // compiles against both a ModelClass* and a SharedModel, so (template) rendering code
+    // can be shared between a Collection and a SharedCollection. Differences: lookup()
+    // returns a pointer to the null-terminated value instead of a string*, and attributes()
+    // returns a copy
+    class SharedModel {
+
+    public: // methods
+
+        SharedModel() : _collection(NULL), mIndex(0){}
+        SharedModel(const SharedCollection *collection, uint32_t index) : _collection(collection), mIndex(index){}
+
+        bool valid() const { return _collection != NULL; }
+        // pointer-like access; an invalid view converts to false, like a NULL model pointer
+        explicit operator bool() const { return valid(); }
+        const SharedModel* operator->() const { return this; }
+        bool operator==(const SharedModel &other) const { return _collection == other._collection && mIndex == other.mIndex; }
+        bool operator!=(const SharedModel &other) const { return !(*this == other); }
+
+        // the attribute's value, straight from shared memory; NULL when the attribute doesn't exist
+        const char* lookup(const string &attr) const;
+        bool has(const string &attr) const { return lookup(attr) != NULL; }
+        bool attrEquals(const string &attr, const string &value) const;
+
+        string get(const string &attr, const string &_default = "") const {
+            const char *value = lookup(attr);
+            return value ? string(value) : _default;
+        }
+
+        string id() const;
+        map<string, string> attributes() const;
+
+        // position in the collection (see SharedCollection::at)
+        uint32_t position() const { return mIndex; }
+
+    protected: // attributes
+
+        friend class SharedCollection;
+        const SharedCollection *_collection;
+        uint32_t mIndex;
+
+    }; // class SharedModel
+
+    // Read-only collection that lives in POSIX shared memory, published by another
+    // process (or by this one) with a SharedCollectionPublisher. Opening it doesn't
+    // parse or copy anything; the models are read straight from the mapped segment.
+    //
+    // The publisher replaces the content by publishing a new generation; call update()
+    // (for example once per frame) to swap to the latest one.
+    //
+    // The read-only part of Collection's API is available under the same names (count, at,
+    // models, findById, findByAttr, has, index, previous, next, random), returning SharedModel
+    // views where Collection returns model pointers. The exception is filterBy; Collection's
+    // filterBy removes models from the collection, this one returns the matching models.
+    //
+    // Usage (render process):
+    //
+    //  CMS::SharedCollection records;
+    //  records.open("records");
+    //  ...
+    //  records.update();
+    //  CMS::SharedModel record = records.findById("123");
+    //  if(record.valid()) ofLog() << record.get("title");
+    //
+    class SharedCollection {
+
+    public: // methods
+
+        SharedCollection() : _control(NULL), _data(NULL), mSize(0){}
+        ~SharedCollection(){ close(); }
+
+        // maps the current generation of the named collection
+        bool open(const string &name);
+        void close();
+        bool isOpen() const { return _data != NULL; }
+
+        // swaps to the latest published generation; returns true when it did.
+        // Invalidates all SharedModel views of the previous generation
+        bool update();
+        uint32_t generation() const { return _data ? header()->generation : 0; }
+
+        unsigned int count() const { return _data ? header()->modelCount : 0; }
+        SharedModel at(unsigned int idx) const;
+        // views of all models, in published order
+        vector<SharedModel> models() const;
+        SharedModel findById(const string &_id) const;
+        SharedModel findByAttr(const string &attr, const string &value) const;
+        // all models with the given value for the given attribute
+        vector<SharedModel> filterBy(const string &attr, const string &value) const;
+
+        bool has(const SharedModel &model) const { return index(model) != INVALID_INDEX; }
+        int index(const SharedModel &model) const {
+            return model.valid() && model._collection == this && model.mIndex < count() ? (int)model.mIndex : INVALID_INDEX;
+        }
+        SharedModel previous(const SharedModel &model) const;
+        SharedModel next(const SharedModel &model) const;
+        int randomIndex() const { return count() == 0 ? -1 : floor(ofRandom(count())); }
+        SharedModel random() const { return count() == 0 ? SharedModel() : at(randomIndex()); }
+
+        const static int INVALID_INDEX = -1;
+
+    protected: // methods
+
+        friend class SharedModel;
+
+        const SharedLayout::Header* header() const { return (const SharedLayout::Header*)_data; }
+        const SharedLayout::ModelEntry* modelEntry(uint32_t index) const {
+            return (const SharedLayout::ModelEntry*)(_data + header()->modelsOffset) + index;
+        }
+        const SharedLayout::AttrEntry* attrEntry(uint32_t index) const {
+            return (const SharedLayout::AttrEntry*)(_data + header()->attrsOffset) + index;
+        }
+        const char* str(uint32_t index) const {
+            const uint32_t *offsets = (const uint32_t*)(_data + header()->stringsOffset);
+            return (const char*)(offsets + header()->stringCount) + offsets[index];
+        }
+        // the value of the attribute of the model at the given index; NULL if it doesn't exist
+        const char* lookup(uint32_t index, const char *attr) const;
+
+        bool mapGeneration(uint32_t generation);
+        void unmapData();
+
+    protected: // attributes
+
+        string mName;
+        const SharedLayout::Control *_control;
+        const char *_data;
+        size_t mSize;
+
+    }; // class SharedCollection
+
+    // Publishes snapshots of a collection's models to POSIX shared memory, for
+    // SharedCollection readers in other processes. Every publish() writes a new generation
+    // in a new segment, then makes it the current generation; readers swap over on their
+    // next update(). The two latest generations are kept around, older ones are unlinked
+    // (readers that still have them mapped can keep using them).
+    //
+    // Everything is unlinked when the publisher is destroyed. Keep names short;
+    // some platforms limit shared memory names to 31 characters.
+    //
+    // Usage (content process):
+    //
+    //  CMS::SharedCollectionPublisher publisher("records");
+    //  records.parse(json);
+    //  publisher.publish(records.models());
+    //
+    class SharedCollectionPublisher {
+
+    public: // methods
+
+        SharedCollectionPublisher(const string &name);
+        ~SharedCollectionPublisher();
+
+        template<class ModelClass>
+        bool publish(const vector<ModelClass*> &models){
+            vector<Model*> base(models.begin(), models.end());
+            return publishModels(base);
+        }
+
+        uint32_t generation(){ return mGeneration; }
+
+    protected: // methods
+
+        bool publishModels(const vector<Model*> &models);
+        void unlinkGeneration(uint32_t generation);
+
+    protected: // attributes
+
+        string mName;
+        SharedLayout::Control *_control;
+        uint32_t mGeneration;
+
+    }; // class SharedCollectionPublisher
+
+}; // namespace CMS
+
+#endif // TARGET_WIN32
+
+#endif /* defined(__ofxCMS__CMSSharedCollection__) */
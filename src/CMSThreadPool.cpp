@@ -0,0 +1,88 @@
+//
+//  CMSThreadPool.cpp
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#include "CMSThreadPool.h"
+
+using namespace CMS;
+
+ThreadPool::ThreadPool(unsigned int threads) : mPending(0), bStopping(false){
+    // the calling thread does its share of the work too
+    for(unsigned int i=1; i<threads; i++){
+        _workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        bStopping = true;
+    }
+
+    mWorkAvailable.notify_all();
+
+    for(size_t i=0; i<_workers.size(); i++){
+        _workers[i].join();
+    }
+}
+
+void ThreadPool::parallelFor(unsigned int count, std::function<void(unsigned int, unsigned int)> job){
+    unsigned int chunks = std::min(size(), count);
+
+    if(chunks <= 1){
+        if(count > 0) job(0, count);
+        return;
+    }
+
+    unsigned int chunkSize = count / chunks;
+    unsigned int remainder = count % chunks;
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        // first chunk is for the calling thread, the rest goes to the workers
+        unsigned int begin = chunkSize + (remainder > 0 ? 1 : 0);
+        for(unsigned int i=1; i<chunks; i++){
+            unsigned int end = begin + chunkSize + (i < remainder ? 1 : 0);
+            _tasks.push_back(std::bind(job, begin, end));
+            begin = end;
+        }
+
+        mPending += chunks - 1;
+    }
+
+    mWorkAvailable.notify_all();
+
+    job(0, chunkSize + (remainder > 0 ? 1 : 0));
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(mPending > 0) mWorkDone.wait(lock);
+}
+
+void ThreadPool::work(){
+    while(true){
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while(_tasks.empty() && !bStopping) mWorkAvailable.wait(lock);
+            if(bStopping && _tasks.empty()) return;
+
+            task = _tasks.front();
+            _tasks.pop_front();
+        }
+
+        task();
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mPending--;
+        }
+
+        mWorkDone.notify_all();
+    }
+}
@@ -0,0 +1,56 @@
+//
+//  CMSThreadPool.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSThreadPool__
+#define __ofxCMS__CMSThreadPool__
+
+#include "ofMain.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace CMS {
+
+    // Minimal fixed-size thread pool, used by collections to evaluate filter
+    // predicates on large collections in parallel (see Collection::setParallelScan).
+    // A single pool can be shared by any number of collections.
+    class ThreadPool{
+
+    public: // methods
+
+        // threads is the total number of threads used for a job, including the calling thread
+        ThreadPool(unsigned int threads = std::thread::hardware_concurrency());
+        ~ThreadPool();
+
+        unsigned int size(){ return _workers.size() + 1; }
+
+        // splits [0, count) into consecutive ranges and calls job(begin, end) for each of them,
+        // on the pool's threads and the calling thread. Returns when all ranges are done.
+        void parallelFor(unsigned int count, std::function<void(unsigned int, unsigned int)> job);
+
+    protected: // methods
+
+        void work();
+
+    protected: // attributes
+
+        vector<std::thread> _workers;
+        std::mutex mMutex;
+        std::condition_variable mWorkAvailable;
+        std::condition_variable mWorkDone;
+
+        deque< std::function<void()> > _tasks;
+        unsigned int mPending;
+        bool bStopping;
+
+    }; // class ThreadPool
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSThreadPool__) */
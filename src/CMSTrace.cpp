@@ -0,0 +1,454 @@
+//
+//  CMSTrace.cpp
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#include "CMSTrace.h"
+#include <cstring>
+
+using namespace CMS;
+
+const char* TraceFormat::opName(unsigned char op){
+    static const char* names[] = {"", "collection", "parse", "applyChanges", "add", "initialize", "remove", "destroy", "destroyBy",
+        "clear", "destroyAll", "set", "modelDestroy", "filterBy", "filterByRange", "removeFilters", "removeFilter", "syncsFrom",
+        "stopSyncing", "clone", "merge"};
+    return op < OP_COUNT ? names[op] : "unknown";
+}
+
+//
+// TraceRecorder
+//
+
+thread_local TraceRecorder* TraceRecorder::tActive = NULL;
+
+bool TraceRecorder::open(const string &path){
+    close();
+
+    mFile = fopen(ofToDataPath(path, true).c_str(), "wb");
+    if(mFile == NULL){
+        ofLogError() << "CMS::TraceRecorder::open() - couldn't open trace file: " << path;
+        return false;
+    }
+
+    fwrite(TraceFormat::MAGIC, 1, sizeof(TraceFormat::MAGIC), mFile);
+    fputc(TraceFormat::VERSION, mFile);
+    mBytes = sizeof(TraceFormat::MAGIC) + 1;
+    mRecords = 0;
+    mLastTime = ofGetElapsedTimeMicros();
+    return true;
+}
+
+void TraceRecorder::close(){
+    if(mFile){
+        fclose(mFile);
+        mFile = NULL;
+    }
+
+    _symbols.clear();
+    _lastParse.clear();
+    _lastModel = NULL;
+    mLastModelRecord.clear();
+}
+
+void TraceRecorder::collection(const string &name, bool fifo, bool destroyOnRemove, bool lazy, int limit, const vector<string> &eagerAttrs){
+    begin(TraceFormat::COLLECTION, name);
+    writeByte((fifo ? 1 : 0) | (destroyOnRemove ? 2 : 0) | (lazy ? 4 : 0));
+    // zigzag; the limit can be NO_LIMIT (-1)
+    writeVarint(limit < 0 ? ((uint64_t)(-(long long)limit) << 1) - 1 : (uint64_t)limit << 1);
+    writeVarint(eagerAttrs.size());
+    for(size_t i=0; i<eagerAttrs.size(); i++) writeSymbol(eagerAttrs[i]);
+    end();
+}
+
+void TraceRecorder::parse(const string &name, const string &jsonText, bool doRemove, bool doUpdate, bool doCreate){
+    if(mFile == NULL) return;
+
+    // refreshes tend to get the same json over and over again
+    map<string, string>::iterator it = _lastParse.find(name);
+    bool same = it != _lastParse.end() && it->second == jsonText;
+
+    begin(TraceFormat::PARSE, name);
+    writeByte((doRemove ? 1 : 0) | (doUpdate ? 2 : 0) | (doCreate ? 4 : 0) | (same ? 8 : 0));
+    if(!same){
+        writeString(jsonText);
+        _lastParse[name] = jsonText;
+    }
+    end();
+}
+
+void TraceRecorder::applyChanges(const string &name, const string &jsonLines){
+    begin(TraceFormat::APPLY_CHANGES, name);
+    writeString(jsonLines);
+    end();
+}
+
+void TraceRecorder::add(const string &name, const vector<Model*> &models, bool notify, bool batch, bool initialize){
+    if(mFile == NULL) return;
+
+    begin(initialize ? TraceFormat::INITIALIZE : TraceFormat::ADD, name);
+    writeByte((notify ? 1 : 0) | (batch ? 2 : 0));
+    writeVarint(models.size());
+    for(size_t i=0; i<models.size(); i++) writeModel(models[i]);
+    end();
+}
+
+void TraceRecorder::remove(const string &name, const vector<Model*> &models, bool doDestroy, bool batch){
+    if(mFile == NULL) return;
+
+    begin(TraceFormat::REMOVE, name);
+    writeByte((doDestroy ? 1 : 0) | (batch ? 2 : 0));
+    writeVarint(models.size());
+    for(size_t i=0; i<models.size(); i++) writeSymbol(models[i]->id());
+    end();
+}
+
+void TraceRecorder::destroy(const string &name, Model *model){
+    if(mFile == NULL) return;
+
+    begin(TraceFormat::DESTROY, name);
+    writeSymbol(model->id());
+    end();
+}
+
+void TraceRecorder::destroyBy(const string &name, const string &attr, const string &value){
+    begin(TraceFormat::DESTROY_BY, name);
+    writeSymbol(attr);
+    writeString(value);
+    end();
+}
+
+void TraceRecorder::set(const string &name, Model *model, const string &attr, const string &value){
+    if(mFile == NULL || repeated(model, TraceFormat::SET, attr, value)) return;
+
+    begin(TraceFormat::SET, name);
+    writeSymbol(model->id());
+    writeSymbol(attr);
+    writeString(value);
+    end();
+
+    _lastModel = model;
+}
+
+void TraceRecorder::modelDestroy(const string &name, Model *model){
+    if(mFile == NULL || repeated(model, TraceFormat::MODEL_DESTROY, "", "")) return;
+
+    begin(TraceFormat::MODEL_DESTROY, name);
+    writeSymbol(model->id());
+    end();
+
+    _lastModel = model;
+}
+
+void TraceRecorder::filterBy(const string &name, const string &attr, const vector<string> &values, bool active, bool reject){
+    begin(TraceFormat::FILTER_BY, name);
+    writeByte((active ? 1 : 0) | (reject ? 2 : 0));
+    writeSymbol(attr);
+    writeVarint(values.size());
+    for(size_t i=0; i<values.size(); i++) writeString(values[i]);
+    end();
+}
+
+void TraceRecorder::filterByRange(const string &name, const string &attr, double min, double max){
+    begin(TraceFormat::FILTER_RANGE, name);
+    writeSymbol(attr);
+    writeDouble(min);
+    writeDouble(max);
+    end();
+}
+
+void TraceRecorder::removeFilters(const string &name, bool resync){
+    begin(TraceFormat::REMOVE_FILTERS, name);
+    writeByte(resync ? 1 : 0);
+    end();
+}
+
+void TraceRecorder::removeFilter(const string &name, const string &attr, bool resync){
+    begin(TraceFormat::REMOVE_FILTER, name);
+    writeSymbol(attr);
+    writeByte(resync ? 1 : 0);
+    end();
+}
+
+void TraceRecorder::syncsFrom(const string &name, const string &source, bool clearFirst){
+    begin(TraceFormat::SYNCS_FROM, name);
+    writeSymbol(source);
+    writeByte(clearFirst ? 1 : 0);
+    end();
+}
+
+void TraceRecorder::clone(const string &name, const string &source){
+    begin(TraceFormat::CLONE, name);
+    writeSymbol(source);
+    end();
+}
+
+void TraceRecorder::merge(const string &name, const string &other){
+    begin(TraceFormat::MERGE, name);
+    writeSymbol(other);
+    end();
+}
+
+void TraceRecorder::begin(unsigned char op, const string &name){
+    mRecord.clear();
+    if(mFile == NULL) return;
+
+    unsigned long long now = ofGetElapsedTimeMicros();
+    writeByte(op);
+    writeVarint(now - mLastTime);
+    writeSymbol(name);
+    mLastTime = now;
+}
+
+void TraceRecorder::end(){
+    if(mFile == NULL) return;
+
+    fwrite(mRecord.data(), 1, mRecord.size(), mFile);
+    mBytes += mRecord.size();
+    mRecords++;
+    // anything in between makes the next model record a new one
+    _lastModel = NULL;
+}
+
+bool TraceRecorder::repeated(Model *model, unsigned char op, const string &attr, const string &value){
+    string record;
+    record.reserve(attr.size() + value.size() + 2);
+    record += (char)op;
+    record += attr;
+    record += '\0';
+    record += value;
+
+    if(model == _lastModel && record == mLastModelRecord) return true;
+    mLastModelRecord.swap(record);
+    return false;
+}
+
+void TraceRecorder::writeVarint(uint64_t value){
+    while(value >= 0x80){
+        mRecord += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    mRecord += (char)value;
+}
+
+void TraceRecorder::writeString(const string &value){
+    writeVarint(value.size());
+    mRecord += value;
+}
+
+void TraceRecorder::writeSymbol(const string &value){
+    map<string, unsigned int>::iterator it = _symbols.find(value);
+    if(it != _symbols.end()){
+        writeVarint(it->second + 1);
+        return;
+    }
+
+    writeVarint(0);
+    writeString(value);
+    unsigned int index = _symbols.size();
+    _symbols[value] = index;
+}
+
+void TraceRecorder::writeDouble(double value){
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for(int i=0; i<8; i++) writeByte((bits >> (i*8)) & 0xff);
+}
+
+void TraceRecorder::writeModel(Model *model){
+    map<string, string> &attrs = model->attributes();
+    writeSymbol(model->id());
+    writeVarint(attrs.size());
+    for(map<string, string>::iterator it = attrs.begin(); it != attrs.end(); it++){
+        writeSymbol(it->first);
+        writeString(it->second);
+    }
+}
+
+//
+// TraceReader
+//
+
+bool TraceReader::load(const string &path){
+    _ops.clear();
+    _symbols.clear();
+    _lastParse.clear();
+    mPos = 0;
+
+    ofBuffer buffer = ofBufferFromFile(path, true);
+    mData = buffer.getText();
+
+    if(mData.size() < sizeof(TraceFormat::MAGIC) + 1 || memcmp(mData.data(), TraceFormat::MAGIC, sizeof(TraceFormat::MAGIC)) != 0){
+        ofLogError() << "CMS::TraceReader::load() - not a trace file: " << path;
+        return false;
+    }
+
+    if((unsigned char)mData[sizeof(TraceFormat::MAGIC)] != TraceFormat::VERSION){
+        ofLogError() << "CMS::TraceReader::load() - unsupported trace version: " << (int)(unsigned char)mData[sizeof(TraceFormat::MAGIC)];
+        return false;
+    }
+
+    mPos = sizeof(TraceFormat::MAGIC) + 1;
+    unsigned long long time = 0;
+
+    while(mPos < mData.size()){
+        TraceOp op;
+        if(!readOp(op)){
+            // a recording that was cut off; keep what we've got
+            ofLogWarning() << "CMS::TraceReader::load() - truncated or invalid record at byte " << mPos << ", read " << _ops.size() << " records";
+            break;
+        }
+
+        time += op.time;
+        op.time = time;
+        _ops.push_back(op);
+    }
+
+    mData.clear();
+    return true;
+}
+
+bool TraceReader::readOp(TraceOp &op){
+    uint64_t value;
+
+    if(!readByte(op.op) || op.op == 0 || op.op >= TraceFormat::OP_COUNT) return false;
+    if(!readVarint(value)) return false;
+    op.time = value;
+    if(!readSymbol(op.collection)) return false;
+
+    switch(op.op){
+        case TraceFormat::COLLECTION:
+            if(!readByte(op.flags) || !readVarint(value)) return false;
+            op.limit = (value & 1) ? -(int)((value + 1) >> 1) : (int)(value >> 1);
+            if(!readVarint(value)) return false;
+            op.values.resize(value);
+            for(size_t i=0; i<op.values.size(); i++){
+                if(!readSymbol(op.values[i])) return false;
+            }
+            return true;
+
+        case TraceFormat::PARSE:
+            if(!readByte(op.flags)) return false;
+            if(op.flags & 8){
+                op.text = _lastParse[op.collection];
+                return true;
+            }
+            if(!readString(op.text)) return false;
+            _lastParse[op.collection] = op.text;
+            return true;
+
+        case TraceFormat::APPLY_CHANGES:
+            return readString(op.text);
+
+        case TraceFormat::ADD:
+        case TraceFormat::INITIALIZE:
+            if(!readByte(op.flags) || !readVarint(value)) return false;
+            op.models.resize(value);
+            for(size_t i=0; i<op.models.size(); i++){
+                if(!readSymbol(op.models[i].first) || !readVarint(value)) return false;
+                for(uint64_t j=0; j<value; j++){
+                    string attr;
+                    if(!readSymbol(attr) || !readString(op.models[i].second[attr])) return false;
+                }
+            }
+            return true;
+
+        case TraceFormat::REMOVE:
+            if(!readByte(op.flags) || !readVarint(value)) return false;
+            op.ids.resize(value);
+            for(size_t i=0; i<op.ids.size(); i++){
+                if(!readSymbol(op.ids[i])) return false;
+            }
+            return true;
+
+        case TraceFormat::DESTROY:
+        case TraceFormat::MODEL_DESTROY:
+            return readSymbol(op.id);
+
+        case TraceFormat::DESTROY_BY:
+            return readSymbol(op.attr) && readString(op.text);
+
+        case TraceFormat::SET:
+            return readSymbol(op.id) && readSymbol(op.attr) && readString(op.text);
+
+        case TraceFormat::FILTER_BY:
+            if(!readByte(op.flags) || !readSymbol(op.attr) || !readVarint(value)) return false;
+            op.values.resize(value);
+            for(size_t i=0; i<op.values.size(); i++){
+                if(!readString(op.values[i])) return false;
+            }
+            return true;
+
+        case TraceFormat::FILTER_RANGE:
+            return readSymbol(op.attr) && readDouble(op.min) && readDouble(op.max);
+
+        case TraceFormat::REMOVE_FILTERS:
+            return readByte(op.flags);
+
+        case TraceFormat::REMOVE_FILTER:
+            return readSymbol(op.attr) && readByte(op.flags);
+
+        case TraceFormat::SYNCS_FROM:
+            return readSymbol(op.other) && readByte(op.flags);
+
+        case TraceFormat::CLONE:
+        case TraceFormat::MERGE:
+            return readSymbol(op.other);
+    }
+
+    // CLEAR, DESTROY_ALL, STOP_SYNCING
+    return true;
+}
+
+bool TraceReader::readByte(unsigned char &value){
+    if(mPos >= mData.size()) return false;
+    value = (unsigned char)mData[mPos++];
+    return true;
+}
+
+bool TraceReader::readVarint(uint64_t &value){
+    value = 0;
+    for(int shift=0; shift<64; shift+=7){
+        unsigned char byte;
+        if(!readByte(byte)) return false;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool TraceReader::readString(string &value){
+    uint64_t length;
+    if(!readVarint(length) || length > mData.size() - mPos) return false;
+    value.assign(mData, mPos, length);
+    mPos += length;
+    return true;
+}
+
+bool TraceReader::readSymbol(string &value){
+    uint64_t index;
+    if(!readVarint(index)) return false;
+
+    if(index == 0){
+        if(!readString(value)) return false;
+        _symbols.push_back(value);
+        return true;
+    }
+
+    if(index > _symbols.size()) return false;
+    value = _symbols[index-1];
+    return true;
+}
+
+bool TraceReader::readDouble(double &value){
+    uint64_t bits = 0;
+    for(int i=0; i<8; i++){
+        unsigned char byte;
+        if(!readByte(byte)) return false;
+        bits |= (uint64_t)byte << (i*8);
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return true;
+}
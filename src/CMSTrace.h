@@ -0,0 +1,255 @@
+//
+//  CMSTrace.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSTrace__
+#define __ofxCMS__CMSTrace__
+
+#include "ofMain.h"
+#include <stdint.h>
+#include <cstdio>
+#include "CMSModel.h"
+
+namespace CMS {
+
+    // Binary trace format; a header ("CMST" + version byte) followed by records:
+    //
+    //  op (byte), microseconds since the previous record (varint), collection (symbol), payload
+    //
+    // varints are unsigned LEB128, strings are a varint length followed by the bytes and
+    // symbols (collection names, model ids, attribute names) are interned; a symbol is either
+    // a varint 0 followed by a string (which becomes the next symbol), or a varint index+1.
+    // Doubles are 8 bytes (little endian IEEE 754). Payloads per op:
+    //
+    //  COLLECTION     flags (byte: fifo, destroy on remove, lazy), zigzag varint limit, eager attributes (varint count, symbols)
+    //  PARSE          flags (byte: remove, update, create, same json as the collection's previous parse), json (string, unless same)
+    //  APPLY_CHANGES  json lines (string)
+    //  ADD/INITIALIZE flags (byte: notify, batch), varint model count, per model: id (symbol), varint count, (symbol, string) pairs
+    //  REMOVE         flags (byte: destroy, batch), varint count, ids (symbols)
+    //  DESTROY        id (symbol)
+    //  DESTROY_BY     attribute (symbol), value (string)
+    //  CLEAR, DESTROY_ALL, STOP_SYNCING  nothing
+    //  SET            id (symbol), attribute (symbol), value (string)
+    //  MODEL_DESTROY  id (symbol)
+    //  FILTER_BY      flags (byte: active, reject), attribute (symbol), varint count, values (strings)
+    //  FILTER_RANGE   attribute (symbol), min (double), max (double)
+    //  REMOVE_FILTERS flags (byte: resync)
+    //  REMOVE_FILTER  attribute (symbol), flags (byte: resync)
+    //  SYNCS_FROM     source collection (symbol), flags (byte: clear first)
+    //  CLONE, MERGE   other collection (symbol)
+    //
+    // Models are identified by Model::id() (which falls back to the cid)
+    namespace TraceFormat {
+        const char MAGIC[4] = {'C', 'M', 'S', 'T'};
+        const unsigned char VERSION = 1;
+
+        enum Op {
+            COLLECTION = 1,
+            PARSE,
+            APPLY_CHANGES,
+            ADD,
+            INITIALIZE,
+            REMOVE,
+            DESTROY,
+            DESTROY_BY,
+            CLEAR,
+            DESTROY_ALL,
+            SET,
+            MODEL_DESTROY,
+            FILTER_BY,
+            FILTER_RANGE,
+            REMOVE_FILTERS,
+            REMOVE_FILTER,
+            SYNCS_FROM,
+            STOP_SYNCING,
+            CLONE,
+            MERGE,
+            OP_COUNT
+        };
+
+        const char* opName(unsigned char op);
+    };
+
+    // Records the operations performed on collections to a binary trace file (see TraceFormat),
+    // which can be re-executed later by a TraceReplayer; this makes it possible to benchmark
+    // (and profile) real workloads, instead of synthetic ones.
+    //
+    // Collections record their API calls (parse, applyChanges, add/remove/destroy, filters,
+    // syncing, ...) and the attribute changes and destroys of their models, once attached
+    // using Collection::setTraceRecorder. Only calls made by the application are recorded,
+    // everything that happens as a result of them (syncing collections, filters removing
+    // changed models, ...) is left to the replay. Calls made from event listeners (the
+    // collections' events and Model::attributeChangedEvent) are application calls, they're
+    // recorded in the order in which they started.
+    //
+    // Use a recorder on a single thread only, and keep it around for as long as it's attached
+    // to any collections.
+    //
+    // Usage:
+    //
+    //  CMS::TraceRecorder recorder;
+    //  recorder.open("session.trace");
+    //  records.setTraceRecorder(&recorder, "records");
+    //  favorites.setTraceRecorder(&recorder, "favorites");
+    //
+    class TraceRecorder {
+
+    public: // types
+
+        // keeps track of nested calls; only the outermost call (depth zero) gets recorded
+        class Scope {
+        public:
+            Scope(TraceRecorder *recorder) : _recorder(recorder), _previous(NULL){
+                if(_recorder){ _recorder->mDepth++; _previous = tActive; tActive = _recorder; }
+            }
+            ~Scope(){ if(_recorder){ _recorder->mDepth--; tActive = _previous; } }
+            // true when this call should be recorded
+            bool record(){ return _recorder && _recorder->isRecording() && _recorder->mDepth == 1; }
+        protected:
+            TraceRecorder *_recorder;
+            TraceRecorder *_previous;
+        };
+
+        // calls made by event listeners are made by the application again;
+        // this resets the depth while notifying listeners
+        class Listeners {
+        public:
+            Listeners(TraceRecorder *recorder) : _recorder(recorder), mDepth(0){
+                if(_recorder){ mDepth = _recorder->mDepth; _recorder->mDepth = 0; }
+            }
+            ~Listeners(){ if(_recorder) _recorder->mDepth = mDepth; }
+        protected:
+            TraceRecorder *_recorder;
+            unsigned int mDepth;
+        };
+
+    public: // methods
+
+        // the recorder of the (innermost) collection call in progress on this thread, if any;
+        // Model::set uses this to notify attributeChangedEvent listeners as application code
+        static TraceRecorder* active(){ return tActive; }
+
+        TraceRecorder() : mFile(NULL), mDepth(0), mLastTime(0), mRecords(0), mBytes(0), _lastModel(NULL){}
+        ~TraceRecorder(){ close(); }
+
+        bool open(const string &path);
+        void close();
+        bool isRecording(){ return mFile != NULL; }
+
+        unsigned int records(){ return mRecords; }
+        // number of bytes written so far (including the header)
+        size_t bytes(){ return mBytes; }
+
+    public: // recording methods (used by Collection)
+
+        void collection(const string &name, bool fifo, bool destroyOnRemove, bool lazy, int limit, const vector<string> &eagerAttrs);
+        void parse(const string &name, const string &jsonText, bool doRemove, bool doUpdate, bool doCreate);
+        void applyChanges(const string &name, const string &jsonLines);
+        void add(const string &name, const vector<Model*> &models, bool notify, bool batch, bool initialize = false);
+        void remove(const string &name, const vector<Model*> &models, bool doDestroy, bool batch);
+        void destroy(const string &name, Model *model);
+        void destroyBy(const string &name, const string &attr, const string &value);
+        void clear(const string &name){ begin(TraceFormat::CLEAR, name); end(); }
+        void destroyAll(const string &name){ begin(TraceFormat::DESTROY_ALL, name); end(); }
+        // model records are only written once when several collections report the same change
+        void set(const string &name, Model *model, const string &attr, const string &value);
+        void modelDestroy(const string &name, Model *model);
+        void filterBy(const string &name, const string &attr, const vector<string> &values, bool active, bool reject);
+        void filterByRange(const string &name, const string &attr, double min, double max);
+        void removeFilters(const string &name, bool resync);
+        void removeFilter(const string &name, const string &attr, bool resync);
+        void syncsFrom(const string &name, const string &source, bool clearFirst);
+        void stopSyncing(const string &name){ begin(TraceFormat::STOP_SYNCING, name); end(); }
+        void clone(const string &name, const string &source);
+        void merge(const string &name, const string &other);
+
+    protected: // methods
+
+        void begin(unsigned char op, const string &name);
+        void end();
+        // true when the same model record was written right before this one
+        bool repeated(Model *model, unsigned char op, const string &attr, const string &value);
+
+        void writeByte(unsigned char value){ mRecord += (char)value; }
+        void writeVarint(uint64_t value);
+        void writeString(const string &value);
+        void writeSymbol(const string &value);
+        void writeDouble(double value);
+        void writeModel(Model *model);
+
+    protected: // attributes
+
+        FILE *mFile;
+        unsigned int mDepth;
+        unsigned long long mLastTime;
+        unsigned int mRecords;
+        size_t mBytes;
+        string mRecord;
+        map<string, unsigned int> _symbols;
+        // last parsed json per collection; repeated refreshes are only written once
+        map<string, string> _lastParse;
+        // last model record (for repeated())
+        Model *_lastModel;
+        string mLastModelRecord;
+
+        static thread_local TraceRecorder *tActive;
+
+    }; // class TraceRecorder
+
+    // a single decoded trace record
+    class TraceOp {
+    public:
+        TraceOp() : op(0), time(0), flags(0), limit(0), min(0.0), max(0.0){}
+
+        unsigned char op;
+        // microseconds since the start of the recording
+        unsigned long long time;
+        string collection;
+        unsigned char flags;
+        // model id, attribute name, other/source collection
+        string id, attr, other;
+        // removed model ids
+        vector<string> ids;
+        // parse/applyChanges json, set/destroyBy value, filter values, eager attributes
+        string text;
+        vector<string> values;
+        int limit;
+        double min, max;
+        // added models; id and attributes
+        vector< pair<string, map<string, string> > > models;
+    };
+
+    // Reads a trace file written by a TraceRecorder
+    class TraceReader {
+
+    public: // methods
+
+        bool load(const string &path);
+        const vector<TraceOp> &ops(){ return _ops; }
+
+    protected: // methods
+
+        bool readOp(TraceOp &op);
+        bool readByte(unsigned char &value);
+        bool readVarint(uint64_t &value);
+        bool readString(string &value);
+        bool readSymbol(string &value);
+        bool readDouble(double &value);
+
+    protected: // attributes
+
+        string mData;
+        size_t mPos;
+        vector<string> _symbols;
+        map<string, string> _lastParse;
+        vector<TraceOp> _ops;
+
+    }; // class TraceReader
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSTrace__) */
@@ -0,0 +1,380 @@
+//
+//  CMSTraceReplayer.h
+//  ofxCMS
+//
+//  Created by Mark van de Korput on 18/10/26.
+//
+//
+
+#ifndef __ofxCMS__CMSTraceReplayer__
+#define __ofxCMS__CMSTraceReplayer__
+
+#include "ofMain.h"
+#include <functional>
+#include "CMSTrace.h"
+#include "CMSCollection.h"
+
+namespace CMS {
+
+    // Re-executes a trace recorded by a TraceRecorder on fresh collections (one per recorded
+    // collection name) and measures how long each operation takes and, when an allocation
+    // counter is given, how many allocations it makes. Creating the models of add() calls
+    // isn't part of the measurement.
+    //
+    // Usage:
+    //
+    //  CMS::TraceReplayer<CMS::Model> replayer;
+    //  replayer.load("session.trace");
+    //  replayer.replay();
+    //  cout << replayer.report();
+    //
+    template<class ModelClass>
+    class TraceReplayer {
+
+    public: // types
+
+        // measurements per operation type
+        class Stats {
+        public:
+            vector<unsigned long long> micros;
+            vector<unsigned long long> allocations;
+        };
+
+    public: // methods
+
+        TraceReplayer() : mMissing(0){}
+        ~TraceReplayer(){ reset(); }
+
+        bool load(const string &path){ return mReader.load(path); }
+        const vector<TraceOp> &ops(){ return mReader.ops(); }
+
+        // returns the number of allocations made so far (for example by counting calls to operator new)
+        void setAllocationCounter(std::function<unsigned long long()> counter){ mAllocationCounter = counter; }
+
+        // replays all loaded operations, starting with empty collections; measurements
+        // of multiple replays are combined. Returns the number of replayed operations
+        unsigned int replay();
+        // deletes the collections and models of the last replay
+        void reset();
+
+        Collection<ModelClass>* collection(const string &name);
+        const map<string, Stats> &stats(){ return _stats; }
+        // operations that referred to models that couldn't be found
+        unsigned int missing(){ return mMissing; }
+        void clearStats(){ _stats.clear(); mMissing = 0; }
+
+        // table with the count, latency percentiles (in microseconds) and average
+        // and maximum allocations per operation type
+        string report();
+
+    protected: // methods
+
+        // models for add/initialize calls; not measured
+        void prepare(const TraceOp &op, vector<ModelClass*> &models);
+        void run(const TraceOp &op, vector<ModelClass*> &models);
+
+        ModelClass* find(Collection<ModelClass> *collection, const string &id);
+        void onModelDestroying(Model &model);
+
+        static unsigned long long percentile(const vector<unsigned long long> &sorted, float p){
+            if(sorted.empty()) return 0;
+            unsigned int idx = (unsigned int)ceil(p * sorted.size());
+            return sorted[idx == 0 ? 0 : idx - 1];
+        }
+
+    protected: // attributes
+
+        TraceReader mReader;
+        std::function<unsigned long long()> mAllocationCounter;
+        map<string, Collection<ModelClass>*> _collections;
+        // models we created (for add/initialize calls) and that weren't destroyed yet
+        set<ModelClass*> _created;
+        // recorded ids of models without an id (their cids) and the ids of the replayed models
+        map<string, string> _ids;
+        map<string, Stats> _stats;
+        unsigned int mMissing;
+
+    }; // class TraceReplayer
+
+
+    // TEMPLATE CLASS IMPLEMENTATION //
+
+
+    template <class ModelClass>
+    unsigned int TraceReplayer<ModelClass>::replay(){
+        reset();
+
+        const vector<TraceOp> &ops = mReader.ops();
+
+        for(int i=0; i<ops.size(); i++){
+            const TraceOp &op = ops[i];
+
+            vector<ModelClass*> models;
+            prepare(op, models);
+
+            unsigned long long allocations = mAllocationCounter ? mAllocationCounter() : 0;
+            unsigned long long startTime = ofGetElapsedTimeMicros();
+
+            run(op, models);
+
+            unsigned long long micros = ofGetElapsedTimeMicros() - startTime;
+            if(mAllocationCounter) allocations = mAllocationCounter() - allocations;
+
+            Stats &stats = _stats[TraceFormat::opName(op.op)];
+            stats.micros.push_back(micros);
+            stats.allocations.push_back(allocations);
+        }
+
+        return ops.size();
+    }
+
+    template <class ModelClass>
+    void TraceReplayer<ModelClass>::reset(){
+        // collections don't own their models; collect everything before they're gone
+        set<ModelClass*> models;
+        for(typename map<string, Collection<ModelClass>*>::iterator it = _collections.begin(); it != _collections.end(); it++){
+            it->second->setDestroyOnRemove(false);
+            models.insert(it->second->models().begin(), it->second->models().end());
+        }
+
+        for(typename map<string, Collection<ModelClass>*>::iterator it = _collections.begin(); it != _collections.end(); it++){
+            delete it->second;
+        }
+        _collections.clear();
+
+        for(typename set<ModelClass*>::iterator it = _created.begin(); it != _created.end(); it++){
+            ofRemoveListener((*it)->beforeDestroyEvent, this, &TraceReplayer<ModelClass>::onModelDestroying);
+            models.insert(*it);
+        }
+        _created.clear();
+
+        for(typename set<ModelClass*>::iterator it = models.begin(); it != models.end(); it++){
+            delete *it;
+        }
+
+        _ids.clear();
+    }
+
+    template <class ModelClass>
+    Collection<ModelClass>* TraceReplayer<ModelClass>::collection(const string &name){
+        typename map<string, Collection<ModelClass>*>::iterator it = _collections.find(name);
+        if(it != _collections.end()) return it->second;
+
+        Collection<ModelClass> *collection = new Collection<ModelClass>();
+        _collections[name] = collection;
+        return collection;
+    }
+
+    template <class ModelClass>
+    void TraceReplayer<ModelClass>::prepare(const TraceOp &op, vector<ModelClass*> &models){
+        if(op.op != TraceFormat::ADD && op.op != TraceFormat::INITIALIZE) return;
+
+        for(int i=0; i<op.models.size(); i++){
+            // the same model can be added to multiple collections
+            ModelClass *model = find(NULL, op.models[i].first);
+
+            if(model == NULL){
+                model = new ModelClass();
+                for(map<string, string>::const_iterator it = op.models[i].second.begin(); it != op.models[i].second.end(); it++){
+                    model->set(it->first, it->second);
+                }
+                model->commit();
+
+                if(model->id() != op.models[i].first) _ids[op.models[i].first] = model->id();
+                _created.insert(model);
+                ofAddListener(model->beforeDestroyEvent, this, &TraceReplayer<ModelClass>::onModelDestroying);
+            }
+
+            models.push_back(model);
+        }
+    }
+
+    template <class ModelClass>
+    void TraceReplayer<ModelClass>::run(const TraceOp &op, vector<ModelClass*> &models){
+        Collection<ModelClass> *target = collection(op.collection);
+
+        switch(op.op){
+            case TraceFormat::COLLECTION:
+                target->setFifo(op.flags & 1);
+                target->setDestroyOnRemove(op.flags & 2);
+                target->setLazyParsing(op.flags & 4, op.values);
+                target->limit(op.limit);
+                return;
+
+            case TraceFormat::PARSE:
+                target->parse(op.text, op.flags & 1, op.flags & 2, op.flags & 4);
+                return;
+
+            case TraceFormat::APPLY_CHANGES:
+                target->applyChanges(op.text);
+                return;
+
+            case TraceFormat::ADD:
+                if(op.flags & 2){
+                    // the rejected models are left to reset()
+                    target->addMany(models, op.flags & 1);
+                } else if(!models.empty()){
+                    target->add(models[0], op.flags & 1);
+                }
+                return;
+
+            case TraceFormat::INITIALIZE:
+                target->addMany(models, false);
+                return;
+
+            case TraceFormat::REMOVE: {
+                vector<ModelClass*> removed;
+                for(int i=0; i<op.ids.size(); i++){
+                    ModelClass *model = find(target, op.ids[i]);
+                    if(model) removed.push_back(model);
+                    else mMissing++;
+                }
+
+                if(op.flags & 2){
+                    target->removeMany(removed, op.flags & 1);
+                } else if(!removed.empty()){
+                    target->remove(removed[0], op.flags & 1);
+                }
+                return;
+            }
+
+            case TraceFormat::DESTROY: {
+                ModelClass *model = find(target, op.id);
+                if(model) target->destroy(model);
+                else mMissing++;
+                return;
+            }
+
+            case TraceFormat::DESTROY_BY:
+                target->destroyBy(op.attr, op.text);
+                return;
+
+            case TraceFormat::CLEAR:
+                target->clear();
+                return;
+
+            case TraceFormat::DESTROY_ALL:
+                target->destroyAll();
+                return;
+
+            case TraceFormat::SET: {
+                ModelClass *model = find(target, op.id);
+                if(model) model->set(op.attr, op.text);
+                else mMissing++;
+                return;
+            }
+
+            case TraceFormat::MODEL_DESTROY: {
+                ModelClass *model = find(target, op.id);
+                if(model == NULL){
+                    mMissing++;
+                    return;
+                }
+
+                // the application owned this one
+                bool created = _created.erase(model) > 0;
+                if(created) ofRemoveListener(model->beforeDestroyEvent, this, &TraceReplayer<ModelClass>::onModelDestroying);
+                model->destroy();
+                delete model;
+                return;
+            }
+
+            case TraceFormat::FILTER_BY: {
+                vector<string> values = op.values;
+                bool active = op.flags & 1;
+
+                if(op.flags & 2){
+                    if(active) target->rejectsBy(op.attr, values);
+                    else target->rejectBy(op.attr, values);
+                } else {
+                    if(active) target->filtersBy(op.attr, values);
+                    else target->filterBy(op.attr, values);
+                }
+                return;
+            }
+
+            case TraceFormat::FILTER_RANGE:
+                target->filterByRange(op.attr, op.min, op.max);
+                return;
+
+            case TraceFormat::REMOVE_FILTERS:
+                target->removeFilters(op.flags & 1);
+                return;
+
+            case TraceFormat::REMOVE_FILTER:
+                target->removeFilter(op.attr, op.flags & 1);
+                return;
+
+            case TraceFormat::SYNCS_FROM:
+                target->syncsFrom(*collection(op.other), op.flags & 1);
+                return;
+
+            case TraceFormat::STOP_SYNCING:
+                target->stopSyncing();
+                return;
+
+            case TraceFormat::CLONE:
+                target->clone(*collection(op.other));
+                return;
+
+            case TraceFormat::MERGE:
+                target->merge(*collection(op.other));
+                return;
+        }
+    }
+
+    template <class ModelClass>
+    ModelClass* TraceReplayer<ModelClass>::find(Collection<ModelClass> *collection, const string &id){
+        map<string, string>::iterator it = _ids.find(id);
+        const string &replayedId = it == _ids.end() ? id : it->second;
+
+        ModelClass *model = collection ? collection->findById(replayedId) : NULL;
+        if(model) return model;
+
+        // it might have left the collection, but still be in another one
+        for(typename map<string, Collection<ModelClass>*>::iterator it = _collections.begin(); it != _collections.end(); it++){
+            model = it->second->findById(replayedId);
+            if(model) return model;
+        }
+
+        return NULL;
+    }
+
+    template <class ModelClass>
+    void TraceReplayer<ModelClass>::onModelDestroying(Model &model){
+        // a collection destroyed it (and will delete it)
+        _created.erase((ModelClass*)&model);
+    }
+
+    template <class ModelClass>
+    string TraceReplayer<ModelClass>::report(){
+        std::stringstream stream;
+        char line[256];
+
+        snprintf(line, sizeof(line), "%-16s %8s %10s %10s %10s %10s %10s %10s\n", "operation", "count", "p50 us", "p90 us", "p99 us", "max us", "avg alloc", "max alloc");
+        stream << line;
+
+        for(typename map<string, Stats>::iterator it = _stats.begin(); it != _stats.end(); it++){
+            vector<unsigned long long> micros = it->second.micros;
+            vector<unsigned long long> &allocations = it->second.allocations;
+            std::sort(micros.begin(), micros.end());
+
+            unsigned long long totalAllocations = 0, maxAllocations = 0;
+            for(int i=0; i<allocations.size(); i++){
+                totalAllocations += allocations[i];
+                maxAllocations = std::max(maxAllocations, allocations[i]);
+            }
+
+            snprintf(line, sizeof(line), "%-16s %8u %10llu %10llu %10llu %10llu %10.1f %10llu\n", it->first.c_str(), (unsigned int)micros.size(),
+                percentile(micros, 0.5f), percentile(micros, 0.9f), percentile(micros, 0.99f), micros.empty() ? 0ull : micros.back(),
+                allocations.empty() ? 0.0 : (double)totalAllocations / allocations.size(), maxAllocations);
+            stream << line;
+        }
+
+        if(mMissing > 0) stream << mMissing << " operation(s) referred to models that couldn't be found\n";
+        return stream.str();
+    }
+
+}; // namespace CMS
+
+#endif /* defined(__ofxCMS__CMSTraceReplayer__) */